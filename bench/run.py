@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Compiles every benchmark at every optimization level, runs each binary several times, and
+prints what it measured as JSON:
+
+    {"benchmarks": [{"name": "fibonacci", "opt_level": 2, "compile_seconds": ...,
+                     "binary_bytes": ..., "runtime_seconds": <median>, "runs": [...]}, ...]}
+
+Binaries are built the way the vfsc script does: vfsc writes the module to stderr, llc makes
+an object of it, and clang links it against the runtime. The output of every level has to be
+the same, so a miscompile fails the run instead of showing up as a speedup.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BUILD = os.path.join(ROOT, "build")
+
+
+def build(source, level, workdir, tools):
+    """Builds a benchmark, returning the path of the binary and the seconds it took."""
+    name = os.path.splitext(os.path.basename(source))[0]
+    bitcode = os.path.join(workdir, "%s.O%d.ll" % (name, level))
+    obj = os.path.join(workdir, "%s.O%d.o" % (name, level))
+    binary = os.path.join(workdir, "%s.O%d" % (name, level))
+
+    start = time.perf_counter()
+
+    with open(bitcode, "wb") as out:
+        result = subprocess.run([tools.vfsc, "-O%d" % level, source], stderr=out)
+
+    if result.returncode != 0:
+        with open(bitcode, "rb") as log:
+            raise RuntimeError("vfsc failed on %s:\n%s" % (source, log.read().decode(errors="replace")))
+
+    subprocess.run([tools.llc, "-O%d" % level, "-relocation-model=pic", "-filetype=obj", bitcode, "-o", obj], check=True)
+    subprocess.run([tools.cc, obj, "-L" + tools.runtime, "-lvfsrt", "-lpthread", "-o", binary], check=True)
+
+    return binary, time.perf_counter() - start
+
+
+def run(binary, runs):
+    """Runs a binary, returning the seconds of every run and a digest of its output."""
+    times = []
+    digest = None
+
+    for _ in range(runs):
+        start = time.perf_counter()
+        result = subprocess.run([binary], stdout=subprocess.PIPE)
+        times.append(time.perf_counter() - start)
+
+        # Main may be void, so only a crash is a failure.
+        if result.returncode < 0:
+            raise RuntimeError("%s died with signal %d" % (binary, -result.returncode))
+
+        digest = hashlib.sha1(result.stdout).hexdigest()
+
+    return times, digest
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("benchmarks", nargs="*", help="sources to run, every bench/*.vfs by default")
+    parser.add_argument("--levels", default="0,1,2,3", help="comma separated optimization levels")
+    parser.add_argument("--runs", type=int, default=5, help="runs of each binary")
+    parser.add_argument("--out", help="file to write the JSON to, instead of stdout")
+    parser.add_argument("--vfsc", default=os.environ.get("VFSC", os.path.join(BUILD, "vfsc")))
+    parser.add_argument("--llc", default=os.environ.get("LLC", "llc"))
+    parser.add_argument("--cc", default=os.environ.get("CC", "clang"))
+    parser.add_argument("--runtime", default=BUILD, help="directory of libvfsrt.a")
+    args = parser.parse_args()
+
+    sources = args.benchmarks or sorted(
+        os.path.join(ROOT, "bench", f) for f in os.listdir(os.path.join(ROOT, "bench")) if f.endswith(".vfs"))
+    levels = [int(level) for level in args.levels.split(",")]
+
+    results = []
+    failed = False
+
+    with tempfile.TemporaryDirectory(prefix="vfs-bench-") as workdir:
+        for source in sources:
+            name = os.path.splitext(os.path.basename(source))[0]
+            outputs = {}
+
+            for level in levels:
+                binary, compile_seconds = build(source, level, workdir, args)
+                times, digest = run(binary, args.runs)
+                outputs[level] = digest
+
+                results.append({
+                    "name": name,
+                    "opt_level": level,
+                    "compile_seconds": compile_seconds,
+                    "binary_bytes": os.path.getsize(binary),
+                    "runtime_seconds": statistics.median(times),
+                    "runs": times,
+                })
+
+                print("%-12s -O%d  %8.3fs  (compile %.3fs, %d bytes)" % (
+                    name, level, statistics.median(times), compile_seconds, os.path.getsize(binary)),
+                    file=sys.stderr)
+
+            if len(set(outputs.values())) > 1:
+                print("%s: output differs between levels %s" % (name, outputs), file=sys.stderr)
+                failed = True
+
+    report = json.dumps({"benchmarks": results}, indent=2)
+
+    if args.out:
+        with open(args.out, "w") as out:
+            out.write(report + "\n")
+    else:
+        print(report)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Writes a synthetic VFS program, for measuring the compiler rather than the code it makes.
+
+The program has the given number of functions and structs. Function bodies nest ifs and
+fors to the given depth and use long arithmetic chains, and functions call each other both
+backwards and forwards. The same arguments always make the same program.
+"""
+
+import argparse
+import random
+import sys
+
+
+class Synthesizer:
+    def __init__(self, functions, structs, depth, chain, statements, seed):
+        self.functions = functions
+        self.structs = structs
+        self.depth = depth
+        self.chain = chain
+        self.statements = statements
+        self.random = random.Random(seed)
+        self.lines = []
+        self.names = 0
+
+    def emit(self, indent, line):
+        self.lines.append("\t" * indent + line)
+
+    def fresh(self, prefix):
+        self.names += 1
+        return "%s%d" % (prefix, self.names)
+
+    def term(self, scope):
+        choice = self.random.random()
+
+        if choice < 0.5 and scope["numbers"]:
+            return self.random.choice(scope["numbers"])
+        elif choice < 0.65 and scope["structs"]:
+            return "%s.%s" % (self.random.choice(scope["structs"]), self.random.choice(["a", "b", "c"]))
+        elif choice < 0.8 and scope["integers"]:
+            return "(%s %% %d + 1)" % (self.random.choice(scope["integers"]), self.random.randint(2, 97))
+        elif choice < 0.9:
+            return "%d.%df" % (self.random.randint(0, 99), self.random.randint(0, 9))
+
+        return str(self.random.randint(0, 1000))
+
+    def expression(self, scope, length):
+        result = self.term(scope)
+
+        for _ in range(length - 1):
+            result += " %s %s" % (self.random.choice(["+", "-", "*"]), self.term(scope))
+
+        return result
+
+    def call(self, scope, caller):
+        # calls go to any function, so about half of them are forward references.
+        callee = self.random.randrange(self.functions)
+
+        if callee == caller:
+            callee = (callee + 1) % self.functions
+
+        return "@F%d(%s, %s)" % (callee, self.expression(scope, 2), self.expression(scope, 2))
+
+    def block(self, scope, depth, indent, caller):
+        scope = {key: list(value) for key, value in scope.items()}
+
+        for _ in range(self.statements):
+            choice = self.random.random()
+
+            if depth > 0 and choice < 0.15:
+                self.emit(indent, "if %s < %s {" % (self.expression(scope, 3), self.expression(scope, 3)))
+                self.block(scope, depth - 1, indent + 1, caller)
+
+                if self.random.random() < 0.5:
+                    self.emit(indent, "} else {")
+                    self.block(scope, depth - 1, indent + 1, caller)
+
+                self.emit(indent, "}")
+            elif depth > 0 and choice < 0.3:
+                counter = self.fresh("i")
+                self.emit(indent, "for %s = 0, %s < %d {" % (counter, counter, self.random.randint(2, 100)))
+
+                inner = {key: list(value) for key, value in scope.items()}
+                inner["integers"].append(counter)
+                inner["numbers"].append(counter)
+
+                self.block(inner, depth - 1, indent + 1, caller)
+                self.emit(indent, "}")
+            elif choice < 0.4 and self.structs > 0:
+                name = self.fresh("s")
+                self.emit(indent, "var %s:#S%d" % (name, self.random.randrange(self.structs)))
+
+                for field in ["a", "b", "c"]:
+                    self.emit(indent, "%s.%s = %s" % (name, field, self.expression(scope, self.chain // 4 + 1)))
+
+                scope["structs"].append(name)
+            elif choice < 0.5 and self.functions > 1:
+                name = self.fresh("r")
+                self.emit(indent, "var %s = %s" % (name, self.call(scope, caller)))
+                scope["integers"].append(name)
+                scope["numbers"].append(name)
+            elif choice < 0.7 and scope["locals"]:
+                self.emit(indent, "%s = %s" % (self.random.choice(scope["locals"]), self.expression(scope, self.chain)))
+            else:
+                name = self.fresh("v")
+                self.emit(indent, "var %s = %s" % (name, self.expression(scope, self.chain)))
+                scope["numbers"].append(name)
+                scope["locals"].append(name)
+
+                # a chain with a float term is a float.
+                if "f" not in self.lines[-1].split("=", 1)[1]:
+                    scope["integers"].append(name)
+
+    def program(self):
+        for i in range(self.structs):
+            self.emit(0, "#S%d" % i)
+            self.emit(1, "int a")
+            self.emit(1, "float b")
+            self.emit(1, "int c")
+            self.emit(0, "End")
+            self.emit(0, "")
+            self.emit(0, "")
+
+        for i in range(self.functions):
+            self.emit(0, "@F%d (int x, float y) : int" % i)
+
+            # the program is only compiled, so nothing keeps its calls from recursing forever.
+            scope = {"numbers": ["x", "y"], "integers": ["x"], "structs": [], "locals": []}
+
+            self.block(scope, self.depth, 1, i)
+            self.emit(1, "return %s" % self.expression(scope, self.chain))
+            self.emit(0, "End")
+            self.emit(0, "")
+            self.emit(0, "")
+
+        self.emit(0, "@Main ()")
+
+        for i in range(min(self.functions, 10)):
+            self.emit(1, "print @F%d(0, 1.5f)" % i)
+
+        self.emit(0, "End")
+
+        return "\n".join(self.lines) + "\n"
+
+
+def synthesize(functions=1000, structs=50, depth=4, chain=20, statements=4, seed=1):
+    return Synthesizer(functions, structs, depth, chain, statements, seed).program()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--functions", type=int, default=1000)
+    parser.add_argument("--structs", type=int, default=50)
+    parser.add_argument("--depth", type=int, default=4, help="how deep ifs and fors nest")
+    parser.add_argument("--chain", type=int, default=20, help="terms of each arithmetic chain")
+    parser.add_argument("--statements", type=int, default=4, help="statements of each block")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", help="file to write, instead of stdout")
+    args = parser.parse_args()
+
+    source = synthesize(args.functions, args.structs, args.depth, args.chain, args.statements, args.seed)
+
+    if args.output:
+        with open(args.output, "w") as out:
+            out.write(source)
+    else:
+        sys.stdout.write(source)
+
+
+if __name__ == "__main__":
+    main()
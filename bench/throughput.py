@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+Measures how fast vfsc compiles synthetic programs of growing size, and prints it as JSON:
+
+    {"programs": [{"functions": 1000, "lines": ..., "bytes": ..., "seconds": ...,
+                   "lines_per_second": ..., "peak_rss_bytes": ...,
+                   "phases": {"Parse": {"seconds": ..., "lines_per_second": ...}, ...}}, ...]}
+
+The phases come from --time-report. Lexing has no phase of its own in a normal compilation,
+so every program is also compiled with --stream, where "Find imports" lexes the whole source
+without parsing it.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+from synth import synthesize
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+PHASES = ["Find imports", "Parse", "Type check", "Generate", "Stream", "Link", "Optimize", "Emit"]
+
+# a row of an LLVM timer report: columns of "seconds (percent%)", the last one being wall time.
+TIMER_ROW = re.compile(r"^\s*((?:[\d.]+\s+\(\s*[\d.]+%\)\s+)+)(.+?)\s*$")
+TIMER_COLUMN = re.compile(r"([\d.]+)\s+\(\s*[\d.]+%\)")
+
+
+def measure(vfsc, source, flags):
+    """Runs vfsc, returning its wall time, its peak RSS in bytes and the time of each phase."""
+    with tempfile.TemporaryFile() as log:
+        start = time.perf_counter()
+        process = subprocess.Popen([vfsc, "--time-report"] + flags + [source],
+                                   stdout=log, stderr=subprocess.DEVNULL)
+        _, status, usage = os.wait4(process.pid, 0)
+        seconds = time.perf_counter() - start
+        process.returncode = os.waitstatus_to_exitcode(status)
+
+        if process.returncode != 0:
+            raise RuntimeError("vfsc failed on %s" % source)
+
+        # the report is printed to stdout, apart from the module.
+        log.seek(0)
+        report = log.read().decode(errors="replace")
+
+    phases = {}
+
+    for line in report.splitlines():
+        row = TIMER_ROW.match(line)
+
+        if row and row.group(2) in PHASES:
+            phases[row.group(2)] = float(TIMER_COLUMN.findall(row.group(1))[-1])
+
+    # ru_maxrss is in kilobytes, but in bytes on macOS.
+    peak = usage.ru_maxrss if sys.platform == "darwin" else usage.ru_maxrss * 1024
+
+    return seconds, peak, phases
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--sizes", default="100,1000,5000", help="comma separated function counts")
+    parser.add_argument("--structs", type=int, default=50)
+    parser.add_argument("--depth", type=int, default=4)
+    parser.add_argument("--chain", type=int, default=20)
+    parser.add_argument("--out", help="file to write the JSON to, instead of stdout")
+    parser.add_argument("--vfsc", default=os.environ.get("VFSC", os.path.join(ROOT, "build", "vfsc")))
+    args = parser.parse_args()
+
+    results = []
+
+    with tempfile.TemporaryDirectory(prefix="vfs-throughput-") as workdir:
+        for functions in [int(size) for size in args.sizes.split(",")]:
+            source = os.path.join(workdir, "synthetic%d.vfs" % functions)
+            text = synthesize(functions, args.structs, args.depth, args.chain)
+
+            with open(source, "w") as out:
+                out.write(text)
+
+            lines = text.count("\n")
+
+            seconds, peak, phases = measure(args.vfsc, source, [])
+            _, stream_peak, stream_phases = measure(args.vfsc, source, ["--stream"])
+
+            phases["Lex"] = stream_phases.get("Find imports", 0.0)
+
+            results.append({
+                "functions": functions,
+                "lines": lines,
+                "bytes": len(text),
+                "seconds": seconds,
+                "lines_per_second": lines / seconds,
+                "peak_rss_bytes": peak,
+                "stream_peak_rss_bytes": stream_peak,
+                "phases": {
+                    name: {
+                        "seconds": phase,
+                        "lines_per_second": lines / phase if phase > 0 else None,
+                    } for name, phase in phases.items()
+                },
+            })
+
+            print("%6d functions  %8d lines  %7.3fs  %10.0f lines/s  %6.1f MB peak (%.1f MB streamed)" % (
+                functions, lines, seconds, lines / seconds, peak / 1048576.0, stream_peak / 1048576.0),
+                file=sys.stderr)
+
+    report = json.dumps({"programs": results}, indent=2)
+
+    if args.out:
+        with open(args.out, "w") as out:
+            out.write(report + "\n")
+    else:
+        print(report)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,36 +1,93 @@
+#include <climits>
+#include <cstdlib>
 #include <iostream>
+#include <iterator>
 #include <vector>
-#include <fstream>
 
-#include "vfs/ast/SyntaxTree.hpp"
-#include "vfs/ast/Generator.hpp"
+#include "vfs/driver/Compiler.hpp"
 
-extern int yyparse();
-
-std::vector<std::shared_ptr<Function>> program;
-std::vector<std::shared_ptr<Struct>> structs;
+static int error(const std::string & message)
+{
+    std::cerr << "Error:" << std::endl;
+    std::cerr << "\033[1;31m" << message << "\033[0m" << std::endl << std::endl;
+    return 1;
+}
 
 int main(int argc, char *argv[])
 {
-	Generator generator;
+    vfs::CompilerOptions options;
+    std::vector<std::string> sources;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
 
-    // redirect input.
-    freopen(argv[1], "r", stdin);
+        if (arg == "--cache-dir") {
+            if (i + 1 >= argc || *argv[i + 1] == '\0') {
+                return error("--cache-dir takes a directory");
+            }
+
+            options.cacheDirectory = argv[++i];
+        } else if (arg == "-j") {
+            const char * value = i + 1 < argc ? argv[++i] : "";
+            char * end = nullptr;
+            long jobs = std::strtol(value, &end, 10);
+
+            if (*value == '\0' || *end != '\0' || jobs < 1 || jobs > INT_MAX) {
+                return error("-j takes a number of jobs, at least 1");
+            }
+
+            options.jobs = (int) jobs;
+        } else if (arg == "--stream") {
+            options.stream = true;
+        } else if (arg == "--time-report") {
+            options.timeReport = true;
+        } else if (arg == "--time-functions") {
+            options.timeFunctions = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--instrument") {
+            options.instrument = true;
+        } else if (arg == "-fprofile-generate") {
+            options.profileGenerate = "default.vfsprof";
+        } else if (arg.compare(0, 19, "-fprofile-generate=") == 0) {
+            options.profileGenerate = arg.substr(19);
+        } else if (arg == "-fprofile-use") {
+            options.profileUse = "default.vfsprof";
+        } else if (arg.compare(0, 14, "-fprofile-use=") == 0) {
+            options.profileUse = arg.substr(14);
+        } else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && arg[2] >= '0' && arg[2] <= '3') {
+            options.optimize = arg[2] - '0';
+        } else {
+            sources.push_back(arg);
+        }
+    }
 
     try {
-        yyparse();
-
-        try {
-            generator.generate(program, structs);
-            generator.dump();
-        } catch (const std::exception & e) {
-            std::cerr << "Generation error:" << std::endl;
-            std::cerr << "\033[1;31m" << e.what() << "\033[0m" << std::endl << std::endl;
+        vfs::Compiler compiler(options);
+
+        std::unique_ptr<llvm::Module> module;
+
+        // with no sources, the program is read from stdin, as `vfsc < file.vfs`.
+        if (sources.empty()) {
+            std::string source((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+            module = compiler.compileSource("stdin.vfs", source);
+        } else {
+            module = compiler.compile(sources);
+        }
+
+        if (module) {
+            vfs::Report::Phase phase(compiler.getReport(), "Emit");
+            module->dump();
         }
 
+        // the module goes to stderr, where vfsc takes it from, so the report cannot.
+        compiler.getReport().print(llvm::outs());
+    } catch (const vfs::CompileError & e) {
+        std::cerr << e.stage << " error:" << std::endl;
+        std::cerr << "\033[1;31m" << e.what() << "\033[0m" << std::endl << std::endl;
+        return 1;
     } catch (const std::exception & e) {
-        std::cerr << "Syntax error:" << std::endl;
-        std::cerr << "\033[1;31m" << e.what() << "\033[0m" << std::endl;
+        return error(e.what());
     }
 
     return 0;
@@ -1,60 +1,207 @@
 #include "Generator.hpp"
 
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+
 #include "../type/Types.hpp"
 
 
-void Generator::generate(std::vector<std::shared_ptr<Function>> program,
-        std::vector<std::shared_ptr<Struct>> structs)
+Generator::Generator(llvm::LLVMContext & context, std::string name, GeneratorOptions options) :
+        context(context),
+        module(new llvm::Module(name, context)), builder(context), typeSys(context), options(options)
 {
-    funcAlias["Print.format"] = llvm::dyn_cast<llvm::Function>(
+    funcAlias[Symbol::get("Print.format")] = llvm::dyn_cast<llvm::Function>(
             module->getOrInsertFunction("printf", llvm::FunctionType::get(
                     typeSys.intTy,
                     llvm::PointerType::get(typeSys.charTy, 0),
                     true
             )));
 
+    builtins[Symbol::get("String.length")] = &Generator::stringLength;
+    builtins[Symbol::get("Builder.append")] = &Generator::builderAppend;
+    builtins[Symbol::get("Builder.string")] = &Generator::builderString;
+    builtins[Symbol::get("File.write")] = &Generator::fileWrite;
+    builtins[Symbol::get("File.copy")] = &Generator::fileCopy;
+    builtins[Symbol::get("Atomic.load")] = &Generator::atomicLoad;
+    builtins[Symbol::get("Atomic.store")] = &Generator::atomicStore;
+    builtins[Symbol::get("Atomic.add")] = &Generator::atomicUpdate;
+    builtins[Symbol::get("Atomic.sub")] = &Generator::atomicUpdate;
+    builtins[Symbol::get("Atomic.swap")] = &Generator::atomicUpdate;
+    builtins[Symbol::get("Atomic.min")] = &Generator::atomicUpdate;
+    builtins[Symbol::get("Atomic.max")] = &Generator::atomicUpdate;
+    builtins[Symbol::get("Atomic.cas")] = &Generator::atomicCompareSwap;
+    builtins[Symbol::get("Atomic.fence")] = &Generator::atomicFence;
+
+    runtimeBuiltins[Symbol::get("File.map")] = "vfs_file_map";
+    runtimeBuiltins[Symbol::get("File.size")] = "vfs_file_size";
+    runtimeBuiltins[Symbol::get("File.create")] = "vfs_file_create";
+    runtimeBuiltins[Symbol::get("File.stdout")] = "vfs_file_stdout";
+    runtimeBuiltins[Symbol::get("File.flush")] = "vfs_file_flush";
+    runtimeBuiltins[Symbol::get("File.close")] = "vfs_file_close";
+    runtimeBuiltins[Symbol::get("Queue.new")] = "vfs_queue_new";
+    runtimeBuiltins[Symbol::get("Queue.push")] = "vfs_queue_push";
+    runtimeBuiltins[Symbol::get("Queue.offer")] = "vfs_queue_offer";
+    runtimeBuiltins[Symbol::get("Queue.pop")] = "vfs_queue_pop";
+    runtimeBuiltins[Symbol::get("Queue.poll")] = "vfs_queue_poll";
+    runtimeBuiltins[Symbol::get("Counter.new")] = "vfs_counter_new";
+    runtimeBuiltins[Symbol::get("Counter.add")] = "vfs_counter_add";
+    runtimeBuiltins[Symbol::get("Counter.sum")] = "vfs_counter_sum";
+}
+
+std::unique_ptr<llvm::Module> Generator::release()
+{
+    if (!counterRecords.empty()) {
+        registerCounters();
+    }
+
+    return std::move(module);
+}
+
+void Generator::generate(const std::vector<Function *> & program,
+        const std::vector<Struct *> & structs)
+{
+    // declare every function first, so they can be called before their definition.
+    declare(program, structs);
+    define(program);
+}
+
+void Generator::define(const std::vector<Function *> & functions)
+{
+    for (auto f : functions) {
+        f->accept(this);
+    }
+}
+
+void Generator::declare(const std::vector<Function *> & program,
+        const std::vector<Struct *> & structs)
+{
     for (auto s : structs) {
         s->accept(this);
     }
 
     for (auto f : program) {
-        f->accept(this);
+        prototype(*f);
     }
 }
 
-llvm::Value * Generator::visit(Function & node)
+llvm::Function * Generator::getFunction(Symbol name)
+{
+    auto it = functions.find(name);
+
+    if (it != functions.end()) {
+        return it->second;
+    }
+
+    return nullptr;
+}
+
+llvm::Function * Generator::prototype(Function & node)
 {
+    static const Symbol mainName = Symbol::get("Main");
+
+    auto function = getFunction(node.getVirtualName());
+
+    if (function != nullptr) {
+        return function;
+    }
+
+    std::string name = node.name == mainName ? "main" : node.getVirtualName().str();
+    bool external = !node.external.empty();
+
+    if (external) {
+        name = node.external.str();
+    }
+
     std::vector<llvm::Type *> parameterTypes;
     for (auto i : node.parameters) {
-        parameterTypes.push_back(i->type->getType(typeSys));
-    }
+        auto type = i->type->getType(typeSys);
 
-    std::string name = node.name;
-    if (node.name == "Main") {
-        name = "main";
-    } else {
-        name = node.getVirtualName();
+        // C takes the characters of strings.
+        if (external && type == typeSys.stringTy) {
+            type = llvm::PointerType::get(typeSys.charTy, 0);
+        }
+
+        parameterTypes.push_back(type);
     }
 
     auto type = llvm::FunctionType::get(node.type->getType(typeSys), parameterTypes, false);
-    auto function = llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, module.get());
+
+    // several functions can import the same C function, as long as they agree on its type.
+    function = external ? module->getFunction(name) : nullptr;
+
+    if (function != nullptr && function->getFunctionType() != type) {
+        throw std::runtime_error("C function " + name + " declared with different types");
+    }
+
+    if (function == nullptr) {
+        function = llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, module.get());
+
+        if (external) {
+            // C expects bools and bytes zero extended, as unsigned char and _Bool.
+            auto isUnsigned = [this](llvm::Type * t) { return t == typeSys.boolTy || t == typeSys.byteTy; };
+
+            for (unsigned i = 0; i < parameterTypes.size(); i++) {
+                if (isUnsigned(parameterTypes[i])) {
+                    function->addAttribute(i + 1, llvm::Attribute::ZExt);
+                }
+            }
+
+            if (isUnsigned(type->getReturnType())) {
+                function->addAttribute(llvm::AttributeSet::ReturnIndex, llvm::Attribute::ZExt);
+            }
+        }
+    }
+
+    functions[node.getVirtualName()] = function;
+
+    return function;
+}
+
+llvm::Value * Generator::visit(Function & node)
+{
+    auto function = prototype(node);
+
+    if (node.isImported()) {
+        return function;
+    }
+
+    if (!function->empty()) {
+        throw std::runtime_error("Function already defined: " + node.getVirtualName().str());
+    }
+
     lastFunction = &node;
 
     // create the block for this function.
-    builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", function));
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+
+    // every variable gets its stack slot up front, as resolved by the type checker.
+    slots.clear();
+    for (auto & local : node.locals) {
+        slots.push_back(builder.CreateAlloca(local.type->getType(typeSys), nullptr, local.name.str()));
+
+        // task variables hold no task until they are assigned, which detachTasks relies on.
+        if (local.type->isTask()) {
+            builder.CreateStore(llvm::Constant::getNullValue(slots.back()->getAllocatedType()), slots.back());
+        }
+    }
+
+    if (options.instrument) {
+        enterProfile(node);
+    }
+
+    if (!options.profileGenerate.empty()) {
+        branchCounters = new llvm::GlobalVariable(*module, llvm::Type::getInt64Ty(context), false,
+                llvm::GlobalValue::InternalLinkage, nullptr, "vfs.pgo.placeholder");
 
-    // create the scope.
-    createScope();
+        addToCounter(0, llvm::ConstantInt::get(llvm::Type::getInt64Ty(context), 1));
+    }
 
     int i = 0;
     for (auto & arg : function->args()) {
         auto parameter = node.parameters[i];
-        arg.setName("param." + parameter->name);
-
-        auto value = parameter->accept(this);
-        builder.CreateStore(&arg, value);
+        arg.setName("param." + parameter->name.str());
 
-        scope().add(parameter->name, value);
+        builder.CreateStore(&arg, parameter->accept(this));
 
         i++;
     }
@@ -62,281 +209,1000 @@ llvm::Value * Generator::visit(Function & node)
     node.block->accept(this);
 
     if (builder.GetInsertBlock()->getTerminator() == nullptr) {
+        detachTasks();
+
+        if (options.instrument) {
+            exitProfile();
+        }
+
         builder.CreateRetVoid();
     }
 
-    popScope();
+    if (isProfiled()) {
+        endProfile(node, function);
+    }
 
     return function;
 }
 
-llvm::Value * Generator::visit(Parameter & parameter)
+void Generator::addToCounter(uint64_t index, llvm::Value * amount)
 {
-    return builder.CreateAlloca(parameter.type->getType(typeSys), nullptr, parameter.name);
+    auto counter = builder.CreateConstInBoundsGEP1_64(branchCounters, index);
+    builder.CreateStore(builder.CreateAdd(builder.CreateLoad(counter), amount), counter);
 }
 
-llvm::Value * Generator::visit(Block & node)
+llvm::BranchInst * Generator::branch(llvm::Value * condition, llvm::BasicBlock * then,
+        llvm::BasicBlock * otherwise, char kind)
 {
-    llvm::Value * last = nullptr;
+    if (!options.profileGenerate.empty()) {
+        // every branch has a counter of evaluations, followed by one of times taken.
+        auto int64 = llvm::Type::getInt64Ty(context);
+        auto index = 1 + 2 * branches.size();
 
-    for (auto i : node.statements) {
-        i->accept(this);
+        addToCounter(index, llvm::ConstantInt::get(int64, 1));
+        addToCounter(index + 1, builder.CreateZExt(condition, int64));
     }
 
-    return last;
+    auto instruction = builder.CreateCondBr(condition, then, otherwise);
+
+    if (isProfiled()) {
+        branches.push_back(instruction);
+        branchKinds.push_back(kind);
+    }
+
+    return instruction;
 }
 
-llvm::Value * Generator::visit(VarDecl & node)
+void Generator::endProfile(Function & node, llvm::Function * function)
 {
-    llvm::Value * initial = nullptr;
+    auto name = node.getVirtualName().str();
+    auto size = 1 + 2 * branches.size();
 
-    if (node.expression != nullptr) {
-        initial = node.expression->accept(this);
+    // FNV-1a of the kinds of the branches.
+    uint64_t hash = 14695981039346656037ULL;
+    for (char kind : branchKinds) {
+        hash = (hash ^ (unsigned char) kind) * 1099511628211ULL;
     }
 
-    llvm::Value * value = nullptr;
+    if (!options.profileGenerate.empty()) {
+        auto int64 = llvm::Type::getInt64Ty(context);
+        auto counterPointer = llvm::PointerType::get(int64, 0);
+        auto bytePointer = llvm::PointerType::get(typeSys.charTy, 0);
+
+        auto countersType = llvm::ArrayType::get(int64, size);
+        auto counters = new llvm::GlobalVariable(*module, countersType, false,
+                llvm::GlobalValue::InternalLinkage, llvm::ConstantAggregateZero::get(countersType),
+                "vfs.pgo.counters." + name);
+
+        branchCounters->replaceAllUsesWith(llvm::ConstantExpr::getBitCast(counters, counterPointer));
+        branchCounters->eraseFromParent();
+        branchCounters = nullptr;
+
+        // laid out as struct vfs_pgo_record: name, hash, size, counters and the next record.
+        auto recordType = llvm::StructType::get(context, { bytePointer, int64, int64, counterPointer, bytePointer });
+
+        auto nameData = llvm::ConstantDataArray::getString(context, name);
+        auto nameGlobal = new llvm::GlobalVariable(*module, nameData->getType(), true,
+                llvm::GlobalValue::PrivateLinkage, nameData, "vfs.pgo.name");
+
+        counterRecords.push_back(new llvm::GlobalVariable(*module, recordType, false,
+                llvm::GlobalValue::InternalLinkage,
+                llvm::ConstantStruct::get(recordType, {
+                        llvm::ConstantExpr::getPointerCast(nameGlobal, bytePointer),
+                        llvm::ConstantInt::get(int64, hash),
+                        llvm::ConstantInt::get(int64, size),
+                        llvm::ConstantExpr::getBitCast(counters, counterPointer),
+                        llvm::ConstantPointerNull::get(bytePointer)
+                }),
+                "vfs.pgo." + name));
+    }
+
+    auto counts = options.profile != nullptr ? options.profile->get(name, hash, size) : nullptr;
+
+    if (counts != nullptr) {
+        llvm::MDBuilder metadata(context);
+
+        for (size_t i = 0; i < branches.size(); i++) {
+            uint64_t evaluated = counts->counters[1 + 2 * i];
+            uint64_t taken = std::min(counts->counters[2 + 2 * i], evaluated);
+            uint64_t skipped = evaluated - taken;
 
-    bool hasDefinedType = node.type != nullptr;
+            if (evaluated == 0) {
+                continue;
+            }
 
-    llvm::Type * type = nullptr;
+            // weights are 32 bits, only their ratio matters.
+            uint64_t scale = evaluated / UINT32_MAX + 1;
 
-    if (node.type == nullptr) {
-        if (initial == nullptr) {
-            throw std::runtime_error("Variable type inference needs a definition.");
+            branches[i]->setMetadata(llvm::LLVMContext::MD_prof, metadata.createBranchWeights(
+                    (uint32_t) (taken / scale) + 1, (uint32_t) (skipped / scale) + 1));
         }
 
-        type = initial->getType();
-    } else {
-        type = node.type->getType(typeSys);
+        if (options.profile->isHot(counts->counters[0])) {
+            function->addFnAttr(llvm::Attribute::InlineHint);
+        } else if (counts->counters[0] == 0) {
+            function->addFnAttr(llvm::Attribute::Cold);
+        }
     }
 
-    if (node.type && node.type->isArray()) {
-        // if this is an array, we should allocate it and then fake it as an initial value.
-        auto arrayType = reinterpret_cast<ArrayType*>(node.type.get());
-        auto arraySize = arrayType->size->accept(this);
-        initial = builder.CreateAlloca(type->getArrayElementType(), arraySize);
-        type = initial->getType();
+    branches.clear();
+    branchKinds.clear();
+}
+
+void Generator::registerCounters()
+{
+    auto voidType = llvm::Type::getVoidTy(context);
+    auto recordPointer = counterRecords.front()->getType();
+    auto bytePointer = llvm::PointerType::get(typeSys.charTy, 0);
+
+    auto pathData = llvm::ConstantDataArray::getString(context, options.profileGenerate);
+    auto path = new llvm::GlobalVariable(*module, pathData->getType(), true,
+            llvm::GlobalValue::PrivateLinkage, pathData, "vfs.pgo.path");
 
-        // this flag has to be disabled, since arrays cannot be casted.
-        hasDefinedType = false;
+    auto registerRecord = module->getOrInsertFunction("vfs_pgo_register",
+            llvm::FunctionType::get(voidType, { recordPointer, bytePointer }, false));
+
+    auto constructor = llvm::Function::Create(llvm::FunctionType::get(voidType, false),
+            llvm::GlobalValue::InternalLinkage, "vfs.pgo.register", module.get());
+
+    llvm::IRBuilder<> constructorBuilder(llvm::BasicBlock::Create(context, "entry", constructor));
+
+    for (auto record : counterRecords) {
+        constructorBuilder.CreateCall(registerRecord, {
+                record, llvm::ConstantExpr::getPointerCast(path, bytePointer) });
     }
 
-    if (node.type && node.type->isStruct()) {
-        // if this is a struct, we should allocate it and then fake it as an initial value.
-        auto structType = typeSys.getStructType(node.type->name);
-        initial = builder.CreateAlloca(structType);
-        type = initial->getType();
+    constructorBuilder.CreateRetVoid();
+
+    llvm::appendToGlobalCtors(*module, constructor, 0);
+    counterRecords.clear();
+}
+
+void Generator::enterProfile(Function & node)
+{
+    auto bytePointer = llvm::PointerType::get(typeSys.charTy, 0);
+    auto int64 = llvm::Type::getInt64Ty(context);
+
+    // laid out as struct vfs_profile_record: the name, and the id the runtime gives it.
+    auto recordType = llvm::StructType::get(context, { bytePointer, int64 });
+
+    auto name = node.getVirtualName().str();
+    auto nameData = llvm::ConstantDataArray::getString(context, name);
+    auto nameGlobal = new llvm::GlobalVariable(*module, nameData->getType(), true,
+            llvm::GlobalValue::PrivateLinkage, nameData, "vfs.profile.name");
+
+    profileRecord = new llvm::GlobalVariable(*module, recordType, false,
+            llvm::GlobalValue::InternalLinkage,
+            llvm::ConstantStruct::get(recordType, {
+                    llvm::ConstantExpr::getPointerCast(nameGlobal, bytePointer),
+                    llvm::ConstantInt::get(int64, -1, true)
+            }),
+            "vfs.profile." + name);
+
+    loopCounter = builder.CreateAlloca(int64, nullptr, "loops");
+    builder.CreateStore(llvm::ConstantInt::get(int64, 0), loopCounter);
+
+    auto enter = module->getOrInsertFunction("vfs_profile_enter", llvm::FunctionType::get(
+            llvm::Type::getVoidTy(context), { profileRecord->getType() }, false));
+
+    builder.CreateCall(enter, { profileRecord });
+}
+
+void Generator::exitProfile()
+{
+    auto exit = module->getOrInsertFunction("vfs_profile_exit", llvm::FunctionType::get(
+            llvm::Type::getVoidTy(context), { profileRecord->getType(), loopCounter->getAllocatedType() },
+            false));
+
+    builder.CreateCall(exit, { profileRecord, builder.CreateLoad(loopCounter) });
+}
+
+void Generator::countIteration()
+{
+    auto count = builder.CreateLoad(loopCounter);
+    builder.CreateStore(builder.CreateAdd(count, llvm::ConstantInt::get(count->getType(), 1)), loopCounter);
+}
+
+llvm::Value * Generator::visit(Parameter & parameter)
+{
+    return slots[parameter.slot];
+}
+
+llvm::Value * Generator::visit(Block & node)
+{
+    llvm::Value * last = nullptr;
 
-        // this flag has to be disabled, since structs cannot be casted.
-        hasDefinedType = false;
+    for (auto i : node.statements) {
+        i->accept(this);
     }
 
-    value = builder.CreateAlloca(type, nullptr, node.name);
+    return last;
+}
+
+llvm::Value * Generator::visit(VarDecl & node)
+{
+    static const Symbol builderName = Symbol::get("builder");
+    static const Symbol atomicName = Symbol::get("atomic");
+
+    auto slot = slots[node.slot];
+    llvm::Value * initial = nullptr;
 
-    if (initial != nullptr) {
-        if (hasDefinedType) {
-            initial = typeSys.cast(initial, node.type->getType(typeSys), builder.GetInsertBlock());
+    if (node.type && node.type->isArray()) {
+        // a declared array is allocated here, and the variable points to it.
+        auto arrayType = static_cast<ArrayType*>(node.type);
+        auto arraySize = arrayType->size->accept(this);
+        initial = allocate(arrayType->element->getType(typeSys), arraySize, node.storage);
+    } else if (node.type && node.type->isStruct()) {
+        // same for a declared struct.
+        initial = allocate(typeSys.getStructType(node.type->name), nullptr, node.storage);
+    } else if (node.expression == nullptr && node.type && node.type->name == builderName) {
+        // and for a builder, which starts empty.
+        auto empty = llvm::Constant::getNullValue(typeSys.builderTy);
+        initial = allocate(typeSys.builderTy, nullptr, node.storage);
+
+        if (node.storage == Storage::Entry) {
+            // the slot is made once, and nothing else holds the builder it had the last time
+            // the declaration ran, so its buffer is freed. It starts empty in the entry block.
+            auto slot = llvm::cast<llvm::AllocaInst>(initial);
+            llvm::IRBuilder<> entryBuilder(slot->getParent(), std::next(llvm::BasicBlock::iterator(slot)));
+            entryBuilder.CreateStore(empty, slot);
+
+            builder.CreateCall(runtime("vfs_builder_free", typeSys.voidTy, { initial->getType() }), { initial });
         }
 
-        builder.CreateStore(initial, value);
+        builder.CreateStore(empty, initial);
+    } else if (node.expression == nullptr && node.type && node.type->name == atomicName) {
+        // and for an atomic, which starts at zero, placed like arrays and structs since tasks
+        // and structs may hold it.
+        initial = allocate(typeSys.atomicTy, nullptr, node.storage);
+        builder.CreateStore(llvm::Constant::getNullValue(typeSys.atomicTy), initial);
+    } else if (node.expression != nullptr) {
+        initial = typeSys.cast(node.expression->accept(this), slot->getAllocatedType(),
+                builder.GetInsertBlock());
     }
 
-    scope().add(node.name, value);
-    return value;
+    // a declaration in a loop replaces the task of the round before.
+    if (lastFunction->locals[node.slot].type->isTask()) {
+        detach(builder.CreateLoad(slot));
+    }
+
+    if (initial != nullptr) {
+        builder.CreateStore(initial, slot);
+    }
+
+    return slot;
 }
 
 llvm::Value * Generator::visit(Assignment & node)
 {
-    auto value = scope().get(node.variable);
-    return builder.CreateStore(node.expression->accept(this), value);
+    auto slot = slots[node.slot];
+    auto value = typeSys.cast(node.expression->accept(this), slot->getAllocatedType(),
+            builder.GetInsertBlock());
+
+    if (lastFunction->locals[node.slot].type->isTask()) {
+        detach(builder.CreateLoad(slot));
+    }
+
+    return builder.CreateStore(value, slot);
 }
 
 llvm::Value * Generator::visit(ArrayAssignment & node)
 {
-    auto array = scope().get(node.variable);
-
-    auto arrayLoad = builder.CreateLoad(array);
+    auto arrayLoad = builder.CreateLoad(slots[node.slot]);
     auto value = node.expression->accept(this);
     auto index = node.index->accept(this);
     auto ptr = builder.CreateInBoundsGEP(arrayLoad, index);
 
+    value = typeSys.cast(value, ptr->getType()->getPointerElementType(), builder.GetInsertBlock());
+
     return builder.CreateStore(value, ptr);
 }
 
 llvm::Value * Generator::visit(VersionInv & node)
 {
-    auto name = (std::string) lastFunction->name;
-    auto virtualName = node.getVirtualName(name);
-    auto function = module->getFunction(virtualName);
+    return call(prototype(*node.target), node.arguments);
+}
 
-    if (function == nullptr) {
-        throw std::runtime_error("Function not defined: " + name);
+llvm::Value * Generator::visit(FunctionCall & node)
+{
+    if (node.target != nullptr) {
+        return call(prototype(*node.target), node.arguments);
+    }
+
+    auto generated = builtins.find(node.getVirtualName());
+
+    if (generated != builtins.end()) {
+        return (this->*generated->second)(node);
+    }
+
+    auto runtimeName = runtimeBuiltins.find(node.getVirtualName());
+
+    if (runtimeName != runtimeBuiltins.end()) {
+        return callRuntime(runtimeName->second, node);
+    }
+
+    auto alias = funcAlias.find(node.getVirtualName());
+
+    if (alias == funcAlias.end()) {
+        throw std::runtime_error("Function not defined: " + node.name.str());
     }
 
-    // TODO: check for arg compatibility.
+    return call(alias->second, node.arguments);
+}
 
+llvm::Value * Generator::call(llvm::Function * function, const std::vector<Expression *> & arguments)
+{
     std::vector<llvm::Value *> values;
-    for (auto i : node.arguments) {
-        values.push_back(i->accept(this));
+    auto parameter = function->arg_begin();
+
+    for (auto i : arguments) {
+        auto value = i->accept(this);
+
+        if (parameter != function->arg_end()) {
+            value = argument(value, parameter->getType());
+            parameter++;
+        } else {
+            // C functions, like printf, take the characters of a string.
+            value = promote(value->getType() == typeSys.stringTy ? cString(value) : value);
+        }
+
+        values.push_back(value);
     }
 
     return builder.CreateCall(function, values);
 }
 
-llvm::Value * Generator::visit(FunctionCall & node)
+llvm::Value * Generator::argument(llvm::Value * value, llvm::Type * parameter)
 {
-    auto function = module->getFunction(node.getVirtualName());
+    if (value->getType() == typeSys.stringTy && parameter != typeSys.stringTy) {
+        value = cString(value);
+    }
 
-    if (function == nullptr) {
-        if (funcAlias.find(node.getVirtualName()) == funcAlias.end()) {
-            throw std::runtime_error("Function not defined: " + node.name);
-        }
+    return typeSys.cast(value, parameter, builder.GetInsertBlock());
+}
 
-        function = funcAlias[node.getVirtualName()];
+llvm::Value * Generator::promote(llvm::Value * value)
+{
+    if (value->getType()->isFloatTy()) {
+        return typeSys.cast(value, typeSys.doubleTy, builder.GetInsertBlock());
+    }
+
+    // bools and bytes are unsigned.
+    if (value->getType() == typeSys.boolTy || value->getType() == typeSys.byteTy) {
+        return builder.CreateZExt(value, typeSys.intTy);
     }
 
-    // TODO: check arg compatibility.
+    return value;
+}
 
+llvm::Value * Generator::callRuntime(const std::string & name, FunctionCall & node)
+{
     std::vector<llvm::Value *> values;
+    std::vector<llvm::Type *> types;
+
     for (auto i : node.arguments) {
         auto value = i->accept(this);
 
-        // variadic function promotion.
-        if (function->isVarArg() && value->getType()->isFloatTy()) {
-            value = typeSys.cast(value, typeSys.doubleTy, builder.GetInsertBlock());
+        if (value->getType() == typeSys.stringTy) {
+            auto slot = temporary(typeSys.stringTy);
+            builder.CreateStore(value, slot);
+            value = slot;
         }
 
         values.push_back(value);
+        types.push_back(value->getType());
     }
 
-    return builder.CreateCall(function, values);
+    return builder.CreateCall(runtime(name, node.type->getType(typeSys), types), values);
 }
 
 llvm::Value * Generator::visit(Return & node)
 {
-    llvm::Value * returnValue = nullptr;
+    auto returnType = lastFunction->type->getType(typeSys);
+    llvm::Value * value = nullptr;
 
     if (node.expression) {
-        returnValue = node.expression->accept(this);
+        auto returnValue = node.expression->accept(this);
 
-        auto type = returnValue->getType();
-        if (type->isVoidTy()) {
-            returnValue = nullptr;
-        } else if (type->getTypeID() == 14 || type->getTypeID() == 13) {
-            returnValue = builder.CreateLoad(returnValue);
+        if (!returnType->isVoidTy()) {
+            value = typeSys.cast(returnValue, returnType, builder.GetInsertBlock());
         }
     }
 
-    return builder.CreateRet(returnValue);
+    detachTasks();
+
+    // the value is computed first, so the calls it makes count as time spent in this function.
+    if (options.instrument) {
+        exitProfile();
+    }
+
+    if (value != nullptr) {
+        return builder.CreateRet(value);
+    }
+
+    return builder.CreateRetVoid();
 }
 
 llvm::Value * Generator::visit(ExpressionStatement & node)
 {
-    return node.expression->accept(this);
+    auto value = node.expression->accept(this);
+
+    // a task spawned as a statement is never awaited.
+    if (dynamic_cast<Spawn *>(node.expression) != nullptr) {
+        detach(value);
+    }
+
+    return value;
 }
 
 llvm::Value * Generator::visit(Identifier & node)
 {
-    auto value = scope().get(node.name);
-
-    if (value == nullptr) {
-        throw std::runtime_error("Symbol not defined: " + node.name);
-    }
-
-    return builder.CreateLoad(value);
+    return builder.CreateLoad(slots[node.slot]);
 }
 
 llvm::Value * Generator::visit(Integer & node)
 {
-    return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), node.value, true);
+    return llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), node.value, true);
 }
 
 llvm::Value * Generator::visit(Float & node)
 {
-    return llvm::ConstantFP::get(llvm::Type::getFloatTy(*context), node.value);
+    return llvm::ConstantFP::get(llvm::Type::getFloatTy(context), node.value);
 }
 
 llvm::Value * Generator::visit(String & node)
 {
-    auto constString = llvm::ConstantDataArray::getString(*context, node.value);
-    auto var = new llvm::GlobalVariable(*module,
-            llvm::ArrayType::get(llvm::IntegerType::get(*context, 8), node.value.length() + 1),
+    auto int64 = llvm::Type::getInt64Ty(context);
+    auto length = llvm::ConstantInt::get(int64, node.value.length());
+
+    if (node.value.length() >= 16) {
+        // the characters of long literals live in a constant of their own.
+        auto chars = llvm::cast<llvm::Constant>(literal(node.value));
+
+        return llvm::ConstantStruct::get(typeSys.stringTy, { length, chars, llvm::ConstantInt::get(int64, 0) });
+    }
+
+    // short literals hold their characters, which cannot be written as a pointer field, so the
+    // value is loaded from a constant laid out as { length, [16 x i8] }.
+    auto chars = llvm::ConstantDataArray::getString(context, node.value);
+    auto padding = llvm::ArrayType::get(typeSys.charTy, 16 - node.value.length() - 1);
+    auto smallType = llvm::StructType::get(context, { int64, chars->getType(), padding });
+
+    auto var = new llvm::GlobalVariable(*module, smallType, true, llvm::GlobalValue::PrivateLinkage,
+            llvm::ConstantStruct::get(smallType, { length, chars, llvm::Constant::getNullValue(padding) }),
+            ".str");
+
+    return builder.CreateLoad(llvm::ConstantExpr::getBitCast(var, llvm::PointerType::get(typeSys.stringTy, 0)));
+}
+
+llvm::Value * Generator::literal(const std::string & text)
+{
+    auto constString = llvm::ConstantDataArray::getString(context, text);
+    auto var = new llvm::GlobalVariable(*module, constString->getType(),
             true, llvm::GlobalValue::PrivateLinkage, constString, ".str");
 
     auto zero = llvm::Constant::getNullValue(typeSys.intTy);
 
-    return builder.CreateInBoundsGEP(var, { zero, zero });
+    return llvm::ConstantExpr::getInBoundsGetElementPtr(var, { zero, zero });
 }
 
-llvm::Value * Generator::visit(BinaryOp & node)
+llvm::Constant * Generator::runtime(const std::string & name, llvm::Type * result,
+        std::vector<llvm::Type *> parameters)
 {
-    auto left = node.left->accept(this);
-    auto right = node.right->accept(this);
+    return module->getOrInsertFunction(name, llvm::FunctionType::get(result, parameters, false));
+}
 
-    // get the type coercion.
-    auto coercion = typeSys.coerce(left->getType(), right->getType());
+llvm::AllocaInst * Generator::temporary(llvm::Type * type, llvm::Value * size)
+{
+    auto & entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+    llvm::IRBuilder<> entryBuilder(&entry, entry.begin());
 
-    // cast the two values to the coerce type (note: if one of them is already of that type,
-    // then no cast is made).
-    auto leftCast = typeSys.cast(left, coercion, builder.GetInsertBlock());
-    auto rightCast = typeSys.cast(right, coercion, builder.GetInsertBlock());
+    return entryBuilder.CreateAlloca(type, size);
+}
 
-    // check if this is a math of a comparison operator.
-    if (node.op == "+" || node.op == "-" || node.op == "/" || node.op == "*" || node.op == "%") {
-        return llvm::BinaryOperator::Create(typeSys.getMathOp(coercion, node.op),
-                leftCast, rightCast, "", builder.GetInsertBlock());
-    } else {
-        if (typeSys.isFP(coercion)) {
-            return builder.CreateFCmp(typeSys.getCmpPredicate(coercion, node.op), leftCast, rightCast);
-        } else {
-            return builder.CreateICmp(typeSys.getCmpPredicate(coercion, node.op), leftCast, rightCast);
-        }
+llvm::Value * Generator::allocate(llvm::Type * type, llvm::Value * size, Storage storage)
+{
+    if (size != nullptr) {
+        size = typeSys.cast(size, typeSys.intTy, builder.GetInsertBlock());
+    }
+
+    if (storage == Storage::Entry) {
+        return temporary(type, size);
+    }
+
+    if (storage == Storage::Stack) {
+        return builder.CreateAlloca(type, size);
+    }
+
+    // heap objects are never freed, like the characters of strings.
+    auto int64 = llvm::Type::getInt64Ty(context);
+    llvm::Value * bytes = llvm::ConstantExpr::getSizeOf(type);
+
+    if (size != nullptr) {
+        bytes = builder.CreateMul(bytes, builder.CreateSExt(size, int64));
     }
+
+    auto memory = builder.CreateCall(runtime("vfs_alloc", llvm::PointerType::get(typeSys.charTy, 0), { int64 }),
+            { bytes });
+
+    return builder.CreateBitCast(memory, llvm::PointerType::get(type, 0));
 }
 
-llvm::Value * Generator::visit(If & node)
+llvm::Value * Generator::cString(llvm::Value * string)
 {
-    auto condition = node.condition->accept(this);
+    auto slot = temporary(typeSys.stringTy);
+    builder.CreateStore(string, slot);
 
-    auto function = builder.GetInsertBlock()->getParent();
+    // short strings hold their characters right after the length.
+    auto bytePointer = llvm::PointerType::get(typeSys.charTy, 0);
+    auto small = builder.CreateBitCast(builder.CreateStructGEP(slot, 1), bytePointer);
+    auto heap = builder.CreateExtractValue(string, 1);
+    auto isSmall = builder.CreateICmpSLT(builder.CreateExtractValue(string, 0),
+            llvm::ConstantInt::get(llvm::Type::getInt64Ty(context), 16));
 
-    auto thenBlock = llvm::BasicBlock::Create(*context, "then", function);
-    auto elseBlock = llvm::BasicBlock::Create(*context, "else");
-    auto mergeBlock = llvm::BasicBlock::Create(*context, "ifcont");
+    return builder.CreateSelect(isSmall, small, heap);
+}
 
-    if (node.elseBlock) {
-        builder.CreateCondBr(condition, thenBlock, elseBlock);
+void Generator::concatenated(Expression * expression, std::vector<Expression *> & parts)
+{
+    auto op = dynamic_cast<BinaryOp *>(expression);
+
+    if (op != nullptr && op->op == Operator::Add && op->type->getType(typeSys) == typeSys.stringTy) {
+        concatenated(op->left, parts);
+        concatenated(op->right, parts);
     } else {
-        builder.CreateCondBr(condition, thenBlock, mergeBlock);
+        parts.push_back(expression);
     }
+}
 
-    builder.SetInsertPoint(thenBlock);
+llvm::Value * Generator::concatenate(BinaryOp & node)
+{
+    std::vector<Expression *> parts;
+    concatenated(&node, parts);
 
-    createScope();
-    node.thenBlock->accept(this);
-    popScope();
+    auto int64 = llvm::Type::getInt64Ty(context);
+    auto stringPointer = llvm::PointerType::get(typeSys.stringTy, 0);
 
-    thenBlock = builder.GetInsertBlock();
+    auto array = temporary(llvm::ArrayType::get(typeSys.stringTy, parts.size()));
+    auto result = temporary(typeSys.stringTy);
 
-    if (thenBlock->getTerminator() == nullptr) {
-        builder.CreateBr(mergeBlock);
+    for (size_t i = 0; i < parts.size(); i++) {
+        builder.CreateStore(parts[i]->accept(this), builder.CreateConstInBoundsGEP2_32(array, 0, i));
     }
 
-    if (node.elseBlock) {
-        function->getBasicBlockList().push_back(elseBlock);
-        builder.SetInsertPoint(elseBlock);
+    auto concat = runtime("vfs_string_concat", typeSys.voidTy, { stringPointer, stringPointer, int64 });
 
-        createScope();
-        node.elseBlock->accept(this);
-        popScope();
+    builder.CreateCall(concat, {
+            result, builder.CreateBitCast(array, stringPointer), llvm::ConstantInt::get(int64, parts.size())
+    });
 
-        builder.CreateBr(mergeBlock);
-    }
+    return builder.CreateLoad(result);
+}
 
-    function->getBasicBlockList().push_back(mergeBlock);
-    builder.SetInsertPoint(mergeBlock);
+llvm::Value * Generator::stringLength(FunctionCall & node)
+{
+    auto string = node.arguments[0]->accept(this);
 
-    return nullptr;
+    return builder.CreateTrunc(builder.CreateExtractValue(string, 0), typeSys.intTy);
+}
+
+llvm::Value * Generator::builderAppend(FunctionCall & node)
+{
+    auto target = node.arguments[0]->accept(this);
+    auto value = node.arguments[1]->accept(this);
+
+    auto int64 = llvm::Type::getInt64Ty(context);
+    auto builderPointer = target->getType();
+
+    if (value->getType() == typeSys.stringTy) {
+        auto slot = temporary(typeSys.stringTy);
+        builder.CreateStore(value, slot);
+
+        return builder.CreateCall(runtime("vfs_builder_append", typeSys.voidTy,
+                { builderPointer, slot->getType() }), { target, slot });
+    }
+
+    if (typeSys.isFP(value->getType())) {
+        return builder.CreateCall(runtime("vfs_builder_append_double", typeSys.voidTy,
+                { builderPointer, typeSys.doubleTy }), { target, typeSys.cast(value, typeSys.doubleTy, builder.GetInsertBlock()) });
+    }
+
+    // bools and bytes are written as unsigned numbers, like print does.
+    value = value->getType() == typeSys.intTy ? builder.CreateSExt(value, int64) : builder.CreateZExt(value, int64);
+
+    return builder.CreateCall(runtime("vfs_builder_append_int", typeSys.voidTy,
+            { builderPointer, int64 }), { target, value });
+}
+
+llvm::Value * Generator::builderString(FunctionCall & node)
+{
+    auto target = node.arguments[0]->accept(this);
+    auto result = temporary(typeSys.stringTy);
+
+    builder.CreateCall(runtime("vfs_builder_finish", typeSys.voidTy,
+            { target->getType(), result->getType() }), { target, result });
+
+    return builder.CreateLoad(result);
+}
+
+llvm::Value * Generator::fileWrite(FunctionCall & node)
+{
+    auto file = node.arguments[0]->accept(this);
+    auto value = node.arguments[1]->accept(this);
+
+    auto int64 = llvm::Type::getInt64Ty(context);
+    auto filePointer = file->getType();
+
+    if (value->getType() == typeSys.stringTy) {
+        auto slot = temporary(typeSys.stringTy);
+        builder.CreateStore(value, slot);
+
+        return builder.CreateCall(runtime("vfs_file_write", typeSys.voidTy,
+                { filePointer, slot->getType() }), { file, slot });
+    }
+
+    if (typeSys.isFP(value->getType())) {
+        return builder.CreateCall(runtime("vfs_file_write_double", typeSys.voidTy,
+                { filePointer, typeSys.doubleTy }), { file, typeSys.cast(value, typeSys.doubleTy, builder.GetInsertBlock()) });
+    }
+
+    value = value->getType() == typeSys.intTy ? builder.CreateSExt(value, int64) : builder.CreateZExt(value, int64);
+
+    return builder.CreateCall(runtime("vfs_file_write_int", typeSys.voidTy,
+            { filePointer, int64 }), { file, value });
+}
+
+llvm::Value * Generator::fileCopy(FunctionCall & node)
+{
+    auto file = node.arguments[0]->accept(this);
+    auto data = node.arguments[1]->accept(this);
+    auto start = typeSys.cast(node.arguments[2]->accept(this), typeSys.intTy, builder.GetInsertBlock());
+    auto count = typeSys.cast(node.arguments[3]->accept(this), typeSys.intTy, builder.GetInsertBlock());
+
+    return builder.CreateCall(runtime("vfs_file_write_bytes", typeSys.voidTy,
+            { file->getType(), data->getType(), typeSys.intTy, typeSys.intTy }), { file, data, start, count });
+}
+
+llvm::AtomicOrdering Generator::ordering(FunctionCall & node, size_t index)
+{
+    if (index >= node.arguments.size()) {
+        return llvm::AtomicOrdering::SequentiallyConsistent;
+    }
+
+    // the type checker made sure it is a string literal.
+    return typeSys.getOrdering(static_cast<String *>(node.arguments[index])->value);
+}
+
+llvm::Value * Generator::atomicLoad(FunctionCall & node)
+{
+    auto cell = node.arguments[0]->accept(this);
+    auto load = builder.CreateLoad(cell);
+
+    // atomic accesses need an explicit alignment.
+    load->setAlignment(4);
+    load->setAtomic(ordering(node, 1));
+
+    return load;
+}
+
+llvm::Value * Generator::atomicStore(FunctionCall & node)
+{
+    auto cell = node.arguments[0]->accept(this);
+    auto value = typeSys.cast(node.arguments[1]->accept(this), typeSys.atomicTy, builder.GetInsertBlock());
+    auto store = builder.CreateStore(value, cell);
+
+    store->setAlignment(4);
+    store->setAtomic(ordering(node, 2));
+
+    return store;
+}
+
+llvm::Value * Generator::atomicUpdate(FunctionCall & node)
+{
+    auto cell = node.arguments[0]->accept(this);
+    auto value = typeSys.cast(node.arguments[1]->accept(this), typeSys.atomicTy, builder.GetInsertBlock());
+
+    // the value the atomic had before.
+    return builder.CreateAtomicRMW(typeSys.getAtomicOp(node.getVirtualName()), cell, value, ordering(node, 2));
+}
+
+llvm::Value * Generator::atomicCompareSwap(FunctionCall & node)
+{
+    auto cell = node.arguments[0]->accept(this);
+    auto expected = typeSys.cast(node.arguments[1]->accept(this), typeSys.atomicTy, builder.GetInsertBlock());
+    auto desired = typeSys.cast(node.arguments[2]->accept(this), typeSys.atomicTy, builder.GetInsertBlock());
+    auto success = ordering(node, 3);
+
+    // failing only reads, so it cannot release.
+    auto exchange = builder.CreateAtomicCmpXchg(cell, expected, desired, success,
+            llvm::AtomicCmpXchgInst::getStrongestFailureOrdering(success));
+
+    return builder.CreateExtractValue(exchange, 1);
+}
+
+llvm::Value * Generator::atomicFence(FunctionCall & node)
+{
+    return builder.CreateFence(ordering(node, 0));
+}
+
+llvm::Value * Generator::visit(BinaryOp & node)
+{
+    if (node.type->getType(typeSys) == typeSys.stringTy) {
+        return concatenate(node);
+    }
+
+    auto left = node.left->accept(this);
+    auto right = node.right->accept(this);
+
+    // get the type coercion.
+    auto coercion = typeSys.coerce(left->getType(), right->getType());
+
+    // cast the two values to the coerce type (note: if one of them is already of that type,
+    // then no cast is made).
+    auto leftCast = typeSys.cast(left, coercion, builder.GetInsertBlock());
+    auto rightCast = typeSys.cast(right, coercion, builder.GetInsertBlock());
+
+    // check if this is a math of a comparison operator.
+    if (isMathOperator(node.op)) {
+        return llvm::BinaryOperator::Create(typeSys.getMathOp(coercion, node.op),
+                leftCast, rightCast, "", builder.GetInsertBlock());
+    } else {
+        auto predicate = typeSys.getCmpPredicate(coercion, node.op);
+
+        if (llvm::CmpInst::isFPPredicate(predicate)) {
+            return builder.CreateFCmp(predicate, leftCast, rightCast);
+        } else {
+            return builder.CreateICmp(predicate, leftCast, rightCast);
+        }
+    }
+}
+
+llvm::Value * Generator::visit(Logical & node)
+{
+    auto left = node.left->accept(this);
+
+    if (speculatable(node.right)) {
+        auto right = node.right->accept(this);
+
+        return node.conjunction ? builder.CreateAnd(left, right) : builder.CreateOr(left, right);
+    }
+
+    auto function = builder.GetInsertBlock()->getParent();
+    auto decided = builder.GetInsertBlock();
+    auto rightBlock = llvm::BasicBlock::Create(context, "logicright", function);
+    auto after = llvm::BasicBlock::Create(context, "logiccont");
+
+    if (node.conjunction) {
+        branch(left, rightBlock, after, '&');
+    } else {
+        branch(left, after, rightBlock, '|');
+    }
+
+    builder.SetInsertPoint(rightBlock);
+    auto right = node.right->accept(this);
+    rightBlock = builder.GetInsertBlock();
+    builder.CreateBr(after);
+
+    function->getBasicBlockList().push_back(after);
+    builder.SetInsertPoint(after);
+
+    // false when && stops at the left side, true when || does.
+    auto result = builder.CreatePHI(typeSys.boolTy, 2);
+    result->addIncoming(llvm::ConstantInt::get(typeSys.boolTy, node.conjunction ? 0 : 1), decided);
+    result->addIncoming(right, rightBlock);
+
+    return result;
+}
+
+llvm::Value * Generator::visit(Not & node)
+{
+    return builder.CreateNot(node.operand->accept(this));
+}
+
+bool Generator::speculatable(Expression * expression)
+{
+    if (dynamic_cast<Integer *>(expression) || dynamic_cast<Float *>(expression)
+            || dynamic_cast<Bool *>(expression) || dynamic_cast<Identifier *>(expression)) {
+        return true;
+    }
+
+    // division traps on zero, and strings are concatenated by the runtime.
+    if (auto operation = dynamic_cast<BinaryOp *>(expression)) {
+        return operation->op != Operator::Div && operation->op != Operator::Mod
+                && operation->left->type->getType(typeSys) != typeSys.stringTy
+                && speculatable(operation->left) && speculatable(operation->right);
+    }
+
+    if (auto negation = dynamic_cast<Not *>(expression)) {
+        return speculatable(negation->operand);
+    }
+
+    if (auto logical = dynamic_cast<Logical *>(expression)) {
+        return speculatable(logical->left) && speculatable(logical->right);
+    }
+
+    return false;
+}
+
+bool Generator::select(If & node, llvm::Value * condition)
+{
+    auto & thenStatements = node.thenBlock->statements;
+    auto then = thenStatements.size() == 1 ? dynamic_cast<Assignment *>(thenStatements[0]) : nullptr;
+
+    if (then == nullptr || !speculatable(then->expression)) {
+        return false;
+    }
+
+    Assignment * otherwise = nullptr;
+
+    if (node.elseBlock) {
+        auto & elseStatements = node.elseBlock->statements;
+        otherwise = elseStatements.size() == 1 ? dynamic_cast<Assignment *>(elseStatements[0]) : nullptr;
+
+        if (otherwise == nullptr || otherwise->slot != then->slot || !speculatable(otherwise->expression)) {
+            return false;
+        }
+    }
+
+    // without an else, the variable keeps its value.
+    auto slot = slots[then->slot];
+    auto type = slot->getAllocatedType();
+    auto thenValue = typeSys.cast(then->expression->accept(this), type, builder.GetInsertBlock());
+    auto elseValue = otherwise != nullptr
+            ? typeSys.cast(otherwise->expression->accept(this), type, builder.GetInsertBlock())
+            : builder.CreateLoad(slot);
+
+    builder.CreateStore(builder.CreateSelect(condition, thenValue, elseValue), slot);
+
+    return true;
+}
+
+llvm::Value * Generator::visit(If & node)
+{
+    auto condition = node.condition->accept(this);
+
+    if (select(node, condition)) {
+        return nullptr;
+    }
+
+    auto function = builder.GetInsertBlock()->getParent();
+
+    auto thenBlock = llvm::BasicBlock::Create(context, "then", function);
+    auto elseBlock = llvm::BasicBlock::Create(context, "else");
+    auto mergeBlock = llvm::BasicBlock::Create(context, "ifcont");
+
+    branch(condition, thenBlock, node.elseBlock ? elseBlock : mergeBlock, 'i');
+
+    builder.SetInsertPoint(thenBlock);
+
+    node.thenBlock->accept(this);
+
+    fallThrough(mergeBlock);
+
+    if (node.elseBlock) {
+        function->getBasicBlockList().push_back(elseBlock);
+        builder.SetInsertPoint(elseBlock);
+
+        node.elseBlock->accept(this);
+
+        fallThrough(mergeBlock);
+    }
+
+    function->getBasicBlockList().push_back(mergeBlock);
+    builder.SetInsertPoint(mergeBlock);
+
+    return nullptr;
+}
+
+llvm::Value * Generator::visit(Match & node)
+{
+    auto function = builder.GetInsertBlock()->getParent();
+    auto after = llvm::BasicBlock::Create(context, "matchcont");
+    auto otherwise = node.otherwise ? llvm::BasicBlock::Create(context, "matchelse") : after;
+
+    std::vector<llvm::BasicBlock *> blocks;
+
+    for (size_t i = 0; i < node.cases.size(); i++) {
+        blocks.push_back(llvm::BasicBlock::Create(context, "matchcase"));
+    }
+
+    if (node.subject->type->getType(typeSys) == typeSys.stringTy) {
+        matchString(node, blocks, otherwise);
+    } else {
+        // the backend makes a jump table, a search or compares of the switch, whichever
+        // suits its values best.
+        auto subject = node.subject->accept(this);
+        auto type = llvm::cast<llvm::IntegerType>(subject->getType());
+        auto dispatch = builder.CreateSwitch(subject, otherwise, node.cases.size());
+
+        for (size_t i = 0; i < node.cases.size(); i++) {
+            for (auto value : node.cases[i].values) {
+                dispatch->addCase(llvm::ConstantInt::get(type, static_cast<Integer *>(value)->value, true), blocks[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < node.cases.size(); i++) {
+        function->getBasicBlockList().push_back(blocks[i]);
+        builder.SetInsertPoint(blocks[i]);
+
+        node.cases[i].block->accept(this);
+
+        fallThrough(after);
+    }
+
+    if (node.otherwise) {
+        function->getBasicBlockList().push_back(otherwise);
+        builder.SetInsertPoint(otherwise);
+
+        node.otherwise->accept(this);
+
+        fallThrough(after);
+    }
+
+    function->getBasicBlockList().push_back(after);
+    builder.SetInsertPoint(after);
+
+    return nullptr;
+}
+
+void Generator::matchString(Match & node, const std::vector<llvm::BasicBlock *> & blocks,
+        llvm::BasicBlock * otherwise)
+{
+    auto function = builder.GetInsertBlock()->getParent();
+    auto int64 = llvm::Type::getInt64Ty(context);
+    auto stringPointer = llvm::PointerType::get(typeSys.stringTy, 0);
+    auto bytePointer = llvm::PointerType::get(typeSys.charTy, 0);
+
+    auto subject = temporary(typeSys.stringTy);
+    builder.CreateStore(node.subject->accept(this), subject);
+
+    auto hash = builder.CreateCall(runtime("vfs_string_hash", int64, { stringPointer }), { subject });
+    auto equals = runtime("vfs_string_equals", typeSys.boolTy, { stringPointer, bytePointer, int64 });
+
+    // the values of the cases by their hash, in order so the module is the same every time.
+    std::map<uint64_t, std::vector<std::pair<String *, llvm::BasicBlock *>>> hashes;
+
+    for (size_t i = 0; i < node.cases.size(); i++) {
+        for (auto value : node.cases[i].values) {
+            auto text = static_cast<String *>(value);
+            hashes[stringHash(text->value)].push_back(std::make_pair(text, blocks[i]));
+        }
+    }
+
+    auto dispatch = builder.CreateSwitch(hash, otherwise, hashes.size());
+
+    for (auto & entry : hashes) {
+        auto test = llvm::BasicBlock::Create(context, "matchtest", function);
+        dispatch->addCase(llvm::ConstantInt::get(llvm::cast<llvm::IntegerType>(int64), entry.first), test);
+
+        // a hash is only ever shared by a few values, which are compared in turn.
+        for (size_t i = 0; i < entry.second.size(); i++) {
+            auto & text = entry.second[i].first->value;
+            auto next = i + 1 < entry.second.size()
+                    ? llvm::BasicBlock::Create(context, "matchtest", function) : otherwise;
+
+            builder.SetInsertPoint(test);
+
+            auto same = builder.CreateCall(equals,
+                    { subject, literal(text), llvm::ConstantInt::get(int64, text.length()) });
+            builder.CreateCondBr(same, entry.second[i].second, next);
+
+            test = next;
+        }
+    }
+}
+
+uint64_t Generator::stringHash(const std::string & text)
+{
+    // FNV-1a.
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (char c : text) {
+        hash = (hash ^ (unsigned char) c) * 1099511628211ULL;
+    }
+
+    return hash;
 }
 
 llvm::Value * Generator::visit(Print & node)
@@ -345,8 +1211,8 @@ llvm::Value * Generator::visit(Print & node)
     auto value = node.expression->accept(this);
 
     auto print = module->getOrInsertFunction("printf",
-            llvm::FunctionType::get(llvm::IntegerType::getInt32Ty(*context),
-                    llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+            llvm::FunctionType::get(llvm::IntegerType::getInt32Ty(context),
+                    llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0),
                     true)
     );
 
@@ -357,48 +1223,51 @@ llvm::Value * Generator::visit(Print & node)
         fType = "%d";
     } else if (value->getType()->isFloatingPointTy()) {
         fType = "%g";
-    } else if (value->getType()->isPointerTy()) {
+    } else if (value->getType() == typeSys.stringTy) {
         fType = "%s";
+        value = cString(value);
     }
 
-    auto format = String(fType + "\n").accept(this);
+    auto format = literal(fType + "\n");
 
-    // if this is a floating pointer, make sure it's a double, since printf needs doubles.
-    if (value->getType()->isFloatingPointTy()) {
-        value = typeSys.cast(value, typeSys.doubleTy, builder.GetInsertBlock());
-    }
-
-    return builder.CreateCall(print, { format, value });
+    return builder.CreateCall(print, { format, promote(value) });
 }
 
 llvm::Value * Generator::visit(For & node)
 {
-    VarDecl initial(node.variable, nullptr, node.initial);
-    auto counter = initial.accept(this);
+    auto counter = slots[node.slot];
+    builder.CreateStore(typeSys.cast(node.initial->accept(this), typeSys.intTy, builder.GetInsertBlock()), counter);
 
     // create the block.
     auto function = builder.GetInsertBlock()->getParent();
-    auto block = llvm::BasicBlock::Create(*context, "forloop", function);
-    auto after = llvm::BasicBlock::Create(*context, "forcont");
+    auto block = llvm::BasicBlock::Create(context, "forloop", function);
+    auto step = llvm::BasicBlock::Create(context, "forstep");
+    auto after = llvm::BasicBlock::Create(context, "forcont");
     auto condition = node.condition->accept(this);
 
     // fall to the block.
-    builder.CreateCondBr(condition, block, after);
+    branch(condition, block, after, 'f');
 
     builder.SetInsertPoint(block);
 
-    createScope();
-    node.block->accept(this);
-    popScope();
+    loopBody(node.block, after, step);
+
+    // increment the counter, which is also where continue goes.
+    function->getBasicBlockList().push_back(step);
+    builder.SetInsertPoint(step);
 
-    // increment the counter.
     auto variable = builder.CreateLoad(counter);
-    auto result = builder.CreateAdd(variable, node.increment->accept(this), "counter");
+    auto increment = typeSys.cast(node.increment->accept(this), typeSys.intTy, builder.GetInsertBlock());
+    auto result = builder.CreateAdd(variable, increment, "counter");
     builder.CreateStore(result, counter);
 
+    if (options.instrument) {
+        countIteration();
+    }
+
     // execute again or stop.
     condition = node.condition->accept(this);
-    builder.CreateCondBr(condition, block, after);
+    branch(condition, block, after, 'b');
 
     // insert the after block.
     function->getBasicBlockList().push_back(after);
@@ -407,16 +1276,150 @@ llvm::Value * Generator::visit(For & node)
     return nullptr;
 }
 
+llvm::Value * Generator::visit(While & node)
+{
+    auto function = builder.GetInsertBlock()->getParent();
+    auto test = llvm::BasicBlock::Create(context, "whiletest");
+    auto block = llvm::BasicBlock::Create(context, "whileloop");
+    auto after = llvm::BasicBlock::Create(context, "whilecont");
+
+    // the condition is only generated once, at the top, and LLVM rotates the loop so it is
+    // tested at the bottom. A do-while is tested at the bottom already.
+    builder.CreateBr(node.first ? block : test);
+
+    function->getBasicBlockList().push_back(block);
+    builder.SetInsertPoint(block);
+
+    // iterations are counted after the body, where continue also goes; the test also runs
+    // once before a while loop, so counting there would be one too many.
+    auto next = test;
+
+    if (options.instrument) {
+        next = llvm::BasicBlock::Create(context, "whilenext");
+    }
+
+    loopBody(node.block, after, next);
+
+    if (options.instrument) {
+        function->getBasicBlockList().push_back(next);
+        builder.SetInsertPoint(next);
+        countIteration();
+        builder.CreateBr(test);
+    }
+
+    function->getBasicBlockList().push_back(test);
+    builder.SetInsertPoint(test);
+
+    branch(node.condition->accept(this), block, after, node.first ? 'd' : 'w');
+
+    function->getBasicBlockList().push_back(after);
+    builder.SetInsertPoint(after);
+
+    return nullptr;
+}
+
+llvm::Value * Generator::visit(Range & node)
+{
+    auto counter = slots[node.slot];
+    auto from = typeSys.cast(node.from->accept(this), typeSys.intTy, builder.GetInsertBlock());
+    auto to = typeSys.cast(node.to->accept(this), typeSys.intTy, builder.GetInsertBlock());
+    auto step = typeSys.cast(node.step->accept(this), typeSys.intTy, builder.GetInsertBlock());
+
+    builder.CreateStore(from, counter);
+
+    auto function = builder.GetInsertBlock()->getParent();
+    auto block = llvm::BasicBlock::Create(context, "rangeloop", function);
+    auto next = llvm::BasicBlock::Create(context, "rangenext");
+    auto after = llvm::BasicBlock::Create(context, "rangecont");
+
+    // the loop is rotated here: a guard, then the test at the bottom. The checker already
+    // refused literal steps that are not positive.
+    auto enter = builder.CreateICmpSLT(from, to);
+
+    if (!llvm::isa<llvm::ConstantInt>(step)) {
+        enter = builder.CreateAnd(enter, builder.CreateICmpSGT(step, llvm::ConstantInt::get(typeSys.intTy, 0)));
+    }
+
+    branch(enter, block, after, 'r');
+
+    builder.SetInsertPoint(block);
+
+    loopBody(node.block, after, next);
+
+    function->getBasicBlockList().push_back(next);
+    builder.SetInsertPoint(next);
+
+    // the next value is computed as an i64, where adding two ints cannot wrap, so a range
+    // that ends near the largest int still stops, and LLVM can still tell how many times the
+    // loop runs. It is only stored back when it is below the end, so it fits an int.
+    auto int64 = llvm::Type::getInt64Ty(context);
+    auto wide = builder.CreateNSWAdd(builder.CreateSExt(builder.CreateLoad(counter), int64),
+            builder.CreateSExt(step, int64), "counter");
+
+    if (options.instrument) {
+        countIteration();
+    }
+
+    auto latch = llvm::BasicBlock::Create(context, "rangestep", function);
+    branch(builder.CreateICmpSLT(wide, builder.CreateSExt(to, int64)), latch, after, 'n');
+
+    builder.SetInsertPoint(latch);
+    builder.CreateStore(builder.CreateTrunc(wide, typeSys.intTy), counter);
+    builder.CreateBr(block);
+
+    function->getBasicBlockList().push_back(after);
+    builder.SetInsertPoint(after);
+
+    return nullptr;
+}
+
+llvm::Value * Generator::visit(Break & node)
+{
+    builder.CreateBr(loops.back().exit);
+
+    // what follows in the block is never run, but still needs a block to go in.
+    auto function = builder.GetInsertBlock()->getParent();
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "afterbreak", function));
+
+    return nullptr;
+}
+
+llvm::Value * Generator::visit(Continue & node)
+{
+    builder.CreateBr(loops.back().next);
+
+    auto function = builder.GetInsertBlock()->getParent();
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "aftercontinue", function));
+
+    return nullptr;
+}
+
+void Generator::fallThrough(llvm::BasicBlock * block)
+{
+    if (builder.GetInsertBlock()->getTerminator() == nullptr) {
+        builder.CreateBr(block);
+    }
+}
+
+void Generator::loopBody(Block * block, llvm::BasicBlock * exit, llvm::BasicBlock * next)
+{
+    loops.push_back({ exit, next });
+    block->accept(this);
+    loops.pop_back();
+
+    fallThrough(next);
+}
+
 llvm::Value * Generator::visit(Array & node)
 {
-    auto first = node.elements[0]->accept(this);
-    auto size = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), node.elements.size(), true);
-    auto array = builder.CreateAlloca(first->getType(), size);
+    auto elementType = static_cast<ArrayType*>(node.type)->element->getType(typeSys);
+    auto size = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), node.elements.size(), true);
+    auto array = allocate(elementType, size, node.storage);
 
     uint i = 0;
     for (auto e : node.elements) {
-        auto value = e->accept(this);
-        auto index = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), i, true);
+        auto value = typeSys.cast(e->accept(this), elementType, builder.GetInsertBlock());
+        auto index = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), i, true);
         auto ptr = llvm::GetElementPtrInst::CreateInBounds(array, {index}, "", builder.GetInsertBlock());
         builder.CreateStore(value, ptr);
         i++;
@@ -427,10 +1430,8 @@ llvm::Value * Generator::visit(Array & node)
 
 llvm::Value * Generator::visit(ArrayIndex & node)
 {
-    auto array = scope().get(node.name);
-
     auto index = node.expression->accept(this);
-    auto loadedArray = builder.CreateLoad(array);
+    auto loadedArray = builder.CreateLoad(slots[node.slot]);
     auto ptr = llvm::GetElementPtrInst::CreateInBounds(loadedArray, {index}, "", builder.GetInsertBlock());
 
     return builder.CreateLoad(ptr);
@@ -438,71 +1439,165 @@ llvm::Value * Generator::visit(ArrayIndex & node)
 
 llvm::Value * Generator::visit(Bool & node)
 {
-    return llvm::ConstantInt::get(llvm::IntegerType::getInt1Ty(llvm::getGlobalContext()),
+    return llvm::ConstantInt::get(llvm::IntegerType::getInt1Ty(context),
             (uint64_t) node.boolean, false);
 }
 
 llvm::Value * Generator::visit(Struct & node)
 {
     std::vector<llvm::Type*> memberTypes;
-    std::vector<std::string> members;
 
-    auto structType = llvm::StructType::create(*context, node.name);
+    // every unit creates its own type, the context renames it if the name is taken;
+    // the linker merges the types of units that share a struct.
+    auto structType = llvm::StructType::create(context, node.name.str());
+
     typeSys.addStructType(node.name, structType);
 
     for (auto m : node.members) {
-        members.push_back(m->name);
         memberTypes.push_back(m->type->getType(typeSys));
     }
 
-    if (structType->isOpaque()) {
-        structType->setBody(memberTypes, false);
-    }
-
-    typeSys.setStructMembers(node.name, members);
+    structType->setBody(memberTypes, false);
 
     return nullptr;
 }
 
 llvm::Value * Generator::visit(StructAssignment & node)
 {
-    auto structPtr = scope().get(node.variable);
-    auto load = builder.CreateLoad(structPtr);
-
-    auto underlyingStruct = new llvm::LoadInst(load);
-
-    if (!underlyingStruct->getType()->isStructTy()) {
-        throw std::runtime_error("This is not a struct: " + node.variable);
-    }
-
-    std::string name = underlyingStruct->getType()->getStructName().str();
-    int memberIndex = typeSys.getStructMemberIndex(name, node.member);
+    auto load = builder.CreateLoad(slots[node.slot]);
 
     auto value = node.expression->accept(this);
     auto zero = llvm::ConstantInt::get(typeSys.intTy, 0, true);
-    auto index = llvm::ConstantInt::get(typeSys.intTy, (uint64_t) memberIndex, true);
+    auto index = llvm::ConstantInt::get(typeSys.intTy, (uint64_t) node.index, true);
     auto ptr = builder.CreateInBoundsGEP(load, { zero, index });
 
+    value = typeSys.cast(value, ptr->getType()->getPointerElementType(), builder.GetInsertBlock());
+
     return builder.CreateStore(value, ptr);
 }
 
 llvm::Value * Generator::visit(StructMember & node)
 {
-    auto structPtr = scope().get(node.variable);
-    auto load = builder.CreateLoad(structPtr);
+    auto load = builder.CreateLoad(slots[node.slot]);
 
-    auto underlyingStruct = new llvm::LoadInst(load);
+    auto zero = llvm::ConstantInt::get(typeSys.intTy, 0, true);
+    auto index = llvm::ConstantInt::get(typeSys.intTy, (uint64_t) node.index, true);
+    auto ptr = builder.CreateInBoundsGEP(load, { zero, index });
 
-    if (!underlyingStruct->getType()->isStructTy()) {
-        throw std::runtime_error("This is not a struct: " + node.variable);
+    return builder.CreateLoad(ptr);
+}
+
+llvm::StructType * Generator::taskFrame(llvm::Function * function)
+{
+    std::vector<llvm::Type *> fields;
+
+    if (!function->getReturnType()->isVoidTy()) {
+        fields.push_back(function->getReturnType());
     }
 
-    std::string name = underlyingStruct->getType()->getStructName().str();
-    int memberIndex = typeSys.getStructMemberIndex(name, node.member);
+    for (auto & parameter : function->args()) {
+        fields.push_back(parameter.getType());
+    }
 
-    auto zero = llvm::ConstantInt::get(typeSys.intTy, 0, true);
-    auto index = llvm::ConstantInt::get(typeSys.intTy, (uint64_t) memberIndex, true);
-    auto ptr = builder.CreateInBoundsGEP(load, { zero, index });
+    return llvm::StructType::get(context, fields);
+}
 
-    return builder.CreateLoad(ptr);
+llvm::Function * Generator::taskThunk(llvm::Function * function)
+{
+    auto it = taskThunks.find(function);
+
+    if (it != taskThunks.end()) {
+        return it->second;
+    }
+
+    auto bytePointer = llvm::PointerType::get(typeSys.charTy, 0);
+    auto thunk = llvm::Function::Create(llvm::FunctionType::get(typeSys.voidTy, { bytePointer }, false),
+            llvm::GlobalValue::InternalLinkage, "vfs.task." + function->getName().str(), module.get());
+
+    llvm::IRBuilder<> thunkBuilder(llvm::BasicBlock::Create(context, "entry", thunk));
+
+    auto frame = thunkBuilder.CreateBitCast(&*thunk->arg_begin(), llvm::PointerType::get(taskFrame(function), 0));
+    bool returns = !function->getReturnType()->isVoidTy();
+
+    std::vector<llvm::Value *> arguments;
+    for (unsigned i = 0; i < function->arg_size(); i++) {
+        arguments.push_back(thunkBuilder.CreateLoad(thunkBuilder.CreateStructGEP(frame, i + returns)));
+    }
+
+    auto result = thunkBuilder.CreateCall(function, arguments);
+
+    if (returns) {
+        thunkBuilder.CreateStore(result, thunkBuilder.CreateStructGEP(frame, 0));
+    }
+
+    thunkBuilder.CreateRetVoid();
+
+    return taskThunks[function] = thunk;
+}
+
+llvm::Value * Generator::visit(Spawn & node)
+{
+    auto function = prototype(*node.call->target);
+    auto frameType = taskFrame(function);
+    auto thunk = taskThunk(function);
+
+    auto bytePointer = llvm::PointerType::get(typeSys.charTy, 0);
+    auto int64 = llvm::Type::getInt64Ty(context);
+
+    auto task = builder.CreateCall(runtime("vfs_task_new", bytePointer, { int64 }),
+            { llvm::ConstantExpr::getSizeOf(frameType) });
+    auto frame = builder.CreateBitCast(task, llvm::PointerType::get(frameType, 0));
+
+    // the arguments are evaluated by the spawning thread, like those of any call.
+    bool returns = !function->getReturnType()->isVoidTy();
+    auto parameter = function->arg_begin();
+
+    for (unsigned i = 0; i < node.call->arguments.size(); i++, parameter++) {
+        auto value = argument(node.call->arguments[i]->accept(this), parameter->getType());
+        builder.CreateStore(value, builder.CreateStructGEP(frame, i + returns));
+    }
+
+    builder.CreateCall(runtime("vfs_task_spawn", typeSys.voidTy, { bytePointer, thunk->getType() }),
+            { task, thunk });
+
+    return task;
+}
+
+llvm::Value * Generator::visit(Await & node)
+{
+    auto task = node.task->accept(this);
+    auto resultType = node.type->getType(typeSys);
+
+    builder.CreateCall(runtime("vfs_task_await", typeSys.voidTy, { task->getType() }), { task });
+
+    // the result is the first field of the frame.
+    llvm::Value * result = nullptr;
+
+    if (!resultType->isVoidTy()) {
+        result = builder.CreateLoad(builder.CreateBitCast(task, llvm::PointerType::get(resultType, 0)));
+    }
+
+    builder.CreateCall(runtime("vfs_task_free", typeSys.voidTy, { task->getType() }), { task });
+
+    // the variable no longer holds a task, so awaiting it again fails instead of reading a
+    // freed frame, and returning does not detach it.
+    if (auto variable = dynamic_cast<Identifier *>(node.task)) {
+        builder.CreateStore(llvm::Constant::getNullValue(task->getType()), slots[variable->slot]);
+    }
+
+    return result;
+}
+
+void Generator::detach(llvm::Value * task)
+{
+    builder.CreateCall(runtime("vfs_task_detach", typeSys.voidTy, { task->getType() }), { task });
+}
+
+void Generator::detachTasks()
+{
+    for (size_t i = 0; i < lastFunction->locals.size(); i++) {
+        if (lastFunction->locals[i].type->isTask()) {
+            detach(builder.CreateLoad(slots[i]));
+        }
+    }
 }
@@ -2,61 +2,304 @@
 
 #include <iostream>
 #include <map>
+#include <unordered_map>
 
-#include "../context/Scope.hpp"
 #include "SyntaxTree.hpp"
+#include "../context/Profile.hpp"
 #include "../type/TypeSys.hpp"
 
 
+/**
+ * What the generator emits besides the program itself.
+ */
+struct GeneratorOptions
+{
+	// call the profiler runtime (vfs/runtime/profile.c) on entry and exit of every function,
+	// and count the iterations of its loops.
+	bool instrument = false;
+
+	// count how often each function is entered and each branch taken, and write the counts
+	// to this file when the program exits. Empty to not count.
+	std::string profileGenerate;
+
+	// counts of an earlier run, used to weight branches and to hint what to inline.
+	const Profile * profile = nullptr;
+};
+
 class Generator
 {
 private:
-	std::shared_ptr<llvm::LLVMContext> context;
+	llvm::LLVMContext & context;
 	
-	std::shared_ptr<llvm::Module> module;
+	std::unique_ptr<llvm::Module> module;
 	
 	llvm::IRBuilder<> builder;
 	
 	Function * lastFunction;
-	
-	std::vector<std::shared_ptr<Scope>> scopes;
+
+	// the stack slots of the variables of the current function, by slot.
+	std::vector<llvm::AllocaInst *> slots;
 
 	TypeSys typeSys;
 
-    std::map<std::string, llvm::Function*> funcAlias;
+	GeneratorOptions options;
+
+	// the profile record of the current function, and the iterations its loops ran so far.
+	llvm::GlobalVariable * profileRecord = nullptr;
+	llvm::AllocaInst * loopCounter = nullptr;
+
+	// the conditional branches of the current function, and what generated each one, for
+	// -fprofile-generate and -fprofile-use.
+	std::vector<llvm::BranchInst *> branches;
+	std::string branchKinds;
+
+	// stands for the counters of the current function until their number is known.
+	llvm::GlobalVariable * branchCounters = nullptr;
+
+	// the counter records of the functions of the module, registered when the program starts.
+	std::vector<llvm::GlobalVariable *> counterRecords;
+
+    std::unordered_map<Symbol, llvm::Function*> funcAlias;
+
+    // builtins generated in place rather than called, by virtual name.
+    std::unordered_map<Symbol, llvm::Value * (Generator::*)(FunctionCall &)> builtins;
+
+    // builtins that call a function of the runtime with the same arguments, by virtual name.
+    std::unordered_map<Symbol, std::string> runtimeBuiltins;
+
+    // every function declared in the module, by virtual name.
+    std::unordered_map<Symbol, llvm::Function*> functions;
+
+    // functions that run a spawned call from its frame, by the function they call.
+    std::unordered_map<llvm::Function *, llvm::Function *> taskThunks;
+
+    // where break and continue go in each loop around the statement being generated,
+    // innermost last.
+    struct LoopTargets
+    {
+        llvm::BasicBlock * exit;
+        llvm::BasicBlock * next;
+    };
+
+    std::vector<LoopTargets> loops;
+
+    llvm::Function * getFunction(Symbol name);
+
+    /**
+     * Calls a function, casting each argument to the type of its parameter.
+     */
+    llvm::Value * call(llvm::Function * function, const std::vector<Expression *> & arguments);
+
+    /**
+     * @return the value as passed to a parameter of the given type.
+     */
+    llvm::Value * argument(llvm::Value * value, llvm::Type * parameter);
+
+    /**
+     * @return the layout of the frame of a spawned call: its result, if any, then its arguments.
+     */
+    llvm::StructType * taskFrame(llvm::Function * function);
+
+    /**
+     * @return a function that makes the call of a frame and stores its result in the frame.
+     */
+    llvm::Function * taskThunk(llvm::Function * function);
+
+    /**
+     * Lets a task that will not be awaited free its frame once it is done. A null task,
+     * already awaited or never spawned, is left alone.
+     */
+    void detach(llvm::Value * task);
+
+    /**
+     * Detaches the tasks still held by the variables of the current function, before it
+     * returns.
+     */
+    void detachTasks();
+
+    /**
+     * Makes the profile record of a function, and reports its entry to the profiler.
+     */
+    void enterProfile(Function & node);
+
+    /**
+     * Reports the exit of the current function to the profiler. Emitted before every return.
+     */
+    void exitProfile();
+
+    void countIteration();
+
+    /**
+     * @return a declaration of a function of the runtime library.
+     */
+    llvm::Constant * runtime(const std::string & name, llvm::Type * result,
+            std::vector<llvm::Type *> parameters);
+
+    /**
+     * @return a stack slot in the entry block, so it is not allocated again on every loop.
+     * The size, if any, has to be a constant.
+     */
+    llvm::AllocaInst * temporary(llvm::Type * type, llvm::Value * size = nullptr);
+
+    /**
+     * Allocates an array of the given size, or a single value if there is no size, where the
+     * escape analysis placed it.
+     */
+    llvm::Value * allocate(llvm::Type * type, llvm::Value * size, Storage storage);
+
+    /**
+     * @return a pointer to a constant, NUL terminated copy of the given text.
+     */
+    llvm::Value * literal(const std::string & text);
+
+    /**
+     * @return a pointer to the NUL terminated characters of a string value.
+     */
+    llvm::Value * cString(llvm::Value * string);
+
+    /**
+     * Collects the operands of a chain of string concatenations.
+     */
+    void concatenated(Expression * expression, std::vector<Expression *> & parts);
+
+    /**
+     * Concatenates every operand of a chain at once, into a single allocation.
+     */
+    llvm::Value * concatenate(BinaryOp & node);
+
+    llvm::Value * stringLength(FunctionCall & node);
+    llvm::Value * builderAppend(FunctionCall & node);
+    llvm::Value * builderString(FunctionCall & node);
+    llvm::Value * fileWrite(FunctionCall & node);
+    llvm::Value * fileCopy(FunctionCall & node);
+    llvm::Value * atomicLoad(FunctionCall & node);
+    llvm::Value * atomicStore(FunctionCall & node);
+    llvm::Value * atomicUpdate(FunctionCall & node);
+    llvm::Value * atomicCompareSwap(FunctionCall & node);
+    llvm::Value * atomicFence(FunctionCall & node);
+
+    /**
+     * @return the memory ordering given to a builtin of atomics at the given argument, or
+     * seq_cst if it has no such argument.
+     */
+    llvm::AtomicOrdering ordering(FunctionCall & node, size_t index);
+
+    /**
+     * Calls a function of the runtime with the arguments of a builtin. Strings are passed by
+     * pointer, like the runtime takes them.
+     */
+    llvm::Value * callRuntime(const std::string & name, FunctionCall & node);
+
+    /**
+     * @return the value as passed to a variadic function, which takes at least an int or a double.
+     */
+    llvm::Value * promote(llvm::Value * value);
+
+    bool isProfiled()
+    {
+        return !options.profileGenerate.empty() || options.profile != nullptr;
+    }
+
+    void addToCounter(uint64_t index, llvm::Value * amount);
+
+    /**
+     * Branches to a block, unless the current one already ended, as it does after a return,
+     * break or continue.
+     */
+    void fallThrough(llvm::BasicBlock * block);
+
+    /**
+     * Generates the block of a loop, with break and continue going to the given blocks.
+     */
+    void loopBody(Block * block, llvm::BasicBlock * exit, llvm::BasicBlock * next);
+
+    /**
+     * @return whether an expression can be evaluated even where the program would not: it
+     * has no effects, cannot fail and is cheap, so evaluating it costs less than a branch
+     * that may be mispredicted.
+     */
+    bool speculatable(Expression * expression);
+
+    /**
+     * Generates an if that only picks what to assign to a variable, as in min, max and abs,
+     * as a select instead of branches, when its values are speculatable.
+     *
+     * @return false, generating nothing, if the if is not one of these.
+     */
+    bool select(If & node, llvm::Value * condition);
+
+    /**
+     * Branches to the block of the case a string equals, or to the otherwise block. Strings
+     * are switched on by their hash, then compared to the value of the case.
+     */
+    void matchString(Match & node, const std::vector<llvm::BasicBlock *> & blocks,
+            llvm::BasicBlock * otherwise);
+
+    /**
+     * @return the hash of a string, as vfs_string_hash computes it when the program runs.
+     */
+    uint64_t stringHash(const std::string & text);
+
+    /**
+     * Creates a conditional branch. It is counted or weighted when the function is profiled.
+     *
+     * @param kind what generated the branch. The kinds of every branch of a function tell
+     * whether a profile still matches it.
+     */
+    llvm::BranchInst * branch(llvm::Value * condition, llvm::BasicBlock * then,
+            llvm::BasicBlock * otherwise, char kind);
+
+    /**
+     * Creates the counters of the current function, or applies the profile to it.
+     */
+    void endProfile(Function & node, llvm::Function * function);
+
+    /**
+     * Registers the counters of every function of the module from a constructor.
+     */
+    void registerCounters();
 
 public:
-	Generator() : context(std::shared_ptr<llvm::LLVMContext>(&llvm::getGlobalContext())),
-		module(new llvm::Module("main", *context)), builder(*context) {}
+	/**
+	 * Creates a generator that emits into a new module of the given context.
+	 *
+	 * Generators on different contexts share nothing, so they can run on different threads.
+	 */
+	Generator(llvm::LLVMContext & context, std::string name = "main",
+			GeneratorOptions options = GeneratorOptions());
 
-	void generate(std::vector<std::shared_ptr<Function>> program,
-            std::vector<std::shared_ptr<Struct>> structs);
+	void generate(const std::vector<Function *> & program,
+            const std::vector<Struct *> & structs);
 
-	void dump()
-	{
-		module->dump();
-	}
-	
-	void createScope()
-	{
-		Scope * parent = nullptr;
+	/**
+	 * Generates the bodies of the given functions, which have to be declared and type
+	 * checked already.
+	 */
+	void define(const std::vector<Function *> & functions);
 
-        if (!scopes.empty()) {
-            parent = scopes.back().get();
-        }
+	/**
+	 * Declares the structs and function prototypes of another compilation unit, so the
+	 * functions generated afterwards can call into it. The bodies are resolved at link time.
+	 */
+	void declare(const std::vector<Function *> & program,
+			const std::vector<Struct *> & structs);
 
-		scopes.push_back(std::make_shared<Scope>(parent));
-	}
-	
-	Scope & scope()
+	llvm::Module * getModule()
 	{
-		return *scopes.back();
+		return module.get();
 	}
 
-	void popScope()
+	/**
+	 * Takes the module out of the generator, which cannot be used afterwards.
+	 */
+	std::unique_ptr<llvm::Module> release();
+
+	void dump()
 	{
-		scopes.pop_back();
+		module->dump();
 	}
+	
+	llvm::Function * prototype(Function & node);
 
 	llvm::Value * visit(Block & node);
     llvm::Value * visit(Struct & node);
@@ -69,11 +312,14 @@ public:
 	llvm::Value * visit(Integer & node);
 	llvm::Value * visit(String & node);
 	llvm::Value * visit(BinaryOp & node);
+	llvm::Value * visit(Logical & node);
+	llvm::Value * visit(Not & node);
 	llvm::Value * visit(Identifier & node);
 	llvm::Value * visit(Return & node);
 	llvm::Value * visit(ExpressionStatement & node);
 	llvm::Value * visit(Assignment & node);
 	llvm::Value * visit(If & node);
+	llvm::Value * visit(Match & node);
 	llvm::Value * visit(Print & node);
 	llvm::Value * visit(Array & node);
 	llvm::Value * visit(ArrayIndex & node);
@@ -81,5 +327,11 @@ public:
 	llvm::Value * visit(ArrayAssignment & node);
 	llvm::Value * visit(StructAssignment & node);
 	llvm::Value * visit(For & node);
+	llvm::Value * visit(While & node);
+	llvm::Value * visit(Range & node);
+	llvm::Value * visit(Break & node);
+	llvm::Value * visit(Continue & node);
 	llvm::Value * visit(Bool & node);
+	llvm::Value * visit(Spawn & node);
+	llvm::Value * visit(Await & node);
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+ * Binary operators. Math operators come first, so they can be told apart with a single compare.
+ */
+enum class Operator
+{
+	Add,
+	Sub,
+	Mul,
+	Div,
+	Mod,
+	Eq,
+	Neq,
+	Less,
+	Greater,
+	Leq,
+	Geq,
+	Count
+};
+
+/**
+ * @return true for +, -, *, / and %.
+ */
+inline bool isMathOperator(Operator op)
+{
+	return op <= Operator::Mod;
+}
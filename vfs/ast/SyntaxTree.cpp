@@ -1,12 +1,9 @@
 #include "SyntaxTree.hpp"
 
 #include "Generator.hpp"
+#include "../sema/TypeChecker.hpp"
 #include "../type/Types.hpp"
 
-Function::Function(std::string name, std::string version, std::vector<std::shared_ptr<Parameter>> parameters,
-				   std::shared_ptr<Block> block) :
-		Function(name, version, parameters, Type::createVoid(), block) {}
-
 llvm::Value * Block::accept(Generator * generator)
 {
 	return generator->visit(*this);
@@ -126,3 +123,213 @@ llvm::Value * StructMember::accept(Generator * generator)
 {
 	return generator->visit(*this);
 }
+
+Type * Block::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * FunctionCall::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * VarDecl::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * BinaryOp::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Parameter::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Return::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Identifier::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Integer::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Float::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * String::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * VersionInv::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * If::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Print::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Assignment::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Function::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * ExpressionStatement::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Array::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * ArrayIndex::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * ArrayAssignment::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * For::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Bool::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * Struct::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * StructAssignment::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+Type * StructMember::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * Spawn::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * Spawn::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * Await::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * Await::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * While::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * While::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * Range::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * Range::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * Break::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * Break::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * Continue::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * Continue::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * Logical::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * Logical::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * Not::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * Not::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
+
+llvm::Value * Match::accept(Generator * generator)
+{
+	return generator->visit(*this);
+}
+
+Type * Match::check(TypeChecker * checker)
+{
+	return checker->visit(*this);
+}
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <memory>
 #include <vector>
 #include <string>
 
@@ -20,6 +19,7 @@
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include "../context/Symbol.hpp"
 #include "../type/TypeSys.hpp"
 
 
@@ -27,246 +27,384 @@ struct Type;
 
 
 class Generator;
+class TypeChecker;
 
-extern size_t yyline;
+/**
+ * Where an array, struct, atomic or builder made by a declaration or a literal lives. Set by
+ * the escape analysis of the type checker.
+ */
+enum class Storage
+{
+	// on the stack of the function, allocated once in its entry block, where LLVM can split
+	// it into scalars.
+	Entry,
+
+	// on the stack, allocated where it is made.
+	Stack,
+
+	// on the heap, since it is still reachable once the function returns.
+	Heap
+};
 
 struct Statement
 {
     virtual ~Statement() = default;
 	virtual llvm::Value * accept(Generator * generator) = 0;
+	virtual Type * check(TypeChecker * checker) = 0;
 };
 
 struct Expression
 {
+	// set by the type checker.
+	Type * type = nullptr;
+
     virtual ~Expression() = default;
 	virtual llvm::Value * accept(Generator * generator) = 0;
+	virtual Type * check(TypeChecker * checker) = 0;
+};
+
+/**
+ * A variable of a function. The type checker gives each one a slot, which is its index in
+ * the locals of the function.
+ */
+struct Local
+{
+	Symbol name;
+	Type * type;
 };
 
 struct Parameter
 {
-	std::string name;
-	std::shared_ptr<Type> type;
+	Symbol name;
+	Type * type;
+	int slot = -1;
 
-	Parameter(std::string name, std::shared_ptr<Type> type) : name(name), type(type) {}
+	Parameter(Symbol name, Type * type) : name(name), type(type) {}
     virtual ~Parameter() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Block
 {
     virtual ~Block() = default;
 
-	std::vector<std::shared_ptr<Statement>> statements;
+	std::vector<Statement *> statements;
 	bool returns = false;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Struct
 {
-    std::string name;
-    std::vector<std::shared_ptr<Parameter>> members;
+    Symbol name;
+    std::vector<Parameter *> members;
 
-    Struct(std::string name, std::vector<std::shared_ptr<Parameter>> members) :
+    Struct(Symbol name, std::vector<Parameter *> members) :
             name(name), members(members) {}
 
     virtual ~Struct() = default;
 
     virtual llvm::Value * accept(Generator * generator);
+    virtual Type * check(TypeChecker * checker);
 };
 
 struct Function
 {
-	std::string name;
-	std::string version;
-	std::vector<std::shared_ptr<Parameter>> parameters;
-	std::shared_ptr<Type> type;
-	std::shared_ptr<Block> block;
+	Symbol name;
+	Symbol version;
+	Symbol virtualName;
+	std::vector<Parameter *> parameters;
+	Type * type;
+
+	// null for functions imported from C.
+	Block * block;
 
-	Function(std::string name, std::string version, std::vector<std::shared_ptr<Parameter>> parameters,
-			std::shared_ptr<Type> type, std::shared_ptr<Block> block) :
-		name(name), version(version), parameters(parameters), type(type), block(block) {}
+	// the C name of a function imported with extern or exported with export, empty otherwise.
+	Symbol external;
 
-	Function(std::string name, std::string version, std::vector<std::shared_ptr<Parameter>> parameters,
-			std::shared_ptr<Block> block);
+	// every variable of the function, parameters first. Set by the type checker.
+	std::vector<Local> locals;
+
+	// whether the array or struct passed to each parameter is still reachable once the
+	// function returns. Set by the type checker, empty if it is not known.
+	std::vector<bool> escapingParameters;
+
+	Function(Symbol name, Symbol version, std::vector<Parameter *> parameters,
+			Type * type, Block * block) :
+		name(name), version(version), virtualName(makeVirtualName(name, version)),
+		parameters(parameters), type(type), block(block), external(Symbol::get("")) {}
 
     virtual ~Function() = default;
 
-	std::string getVirtualName()
+	/**
+	 * @return the name a version of a function is known by: Name.version
+	 */
+	static Symbol makeVirtualName(Symbol name, Symbol version)
 	{
 		if (version.empty()) {
 			return name;
 		}
 
-		return name + "." + version;
+		return Symbol::get(name.str() + "." + version.str());
+	}
+
+	Symbol getVirtualName()
+	{
+		return virtualName;
+	}
+
+	/**
+	 * @return true if the function is written in C, and only declared here.
+	 */
+	bool isImported()
+	{
+		return block == nullptr;
 	}
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct VarDecl : Statement
 {
-	std::string name;
-	std::shared_ptr<Type> type;
-	std::shared_ptr<Expression> expression;
+	Symbol name;
+	Type * type;
+	Expression * expression;
+	int slot = -1;
+
+	// for declared arrays, structs, atomics and builders.
+	Storage storage = Storage::Stack;
 
-	VarDecl(std::string name, std::shared_ptr<Type> type, std::shared_ptr<Expression> expression) :
+	VarDecl(Symbol name, Type * type, Expression * expression) :
 		name(name), type(type), expression(expression) {}
 
-	VarDecl(std::string name, std::shared_ptr<Type> type) : name(name), type(type) {}
+	VarDecl(Symbol name, Type * type) : name(name), type(type), expression(nullptr) {}
 
     virtual ~VarDecl() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct ExpressionStatement : Statement
 {
-	std::shared_ptr<Expression> expression;
+	Expression * expression;
 
-	ExpressionStatement(std::shared_ptr<Expression> expression) : expression(expression) {}
+	ExpressionStatement(Expression * expression) : expression(expression) {}
 
     virtual ~ExpressionStatement() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Assignment : Statement
 {
-	std::string variable;
-	std::shared_ptr<Expression> expression;
+	Symbol variable;
+	Expression * expression;
+	int slot = -1;
 
-	Assignment(std::string variable, std::shared_ptr<Expression> expression) :
+	Assignment(Symbol variable, Expression * expression) :
 		variable(variable), expression(expression) {}
 
     virtual ~Assignment() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct ArrayAssignment : Statement
 {
-	std::string variable;
-	std::shared_ptr<Expression> index;
-	std::shared_ptr<Expression> expression;
+	Symbol variable;
+	Expression * index;
+	Expression * expression;
+	int slot = -1;
 
-	ArrayAssignment(std::string variable, std::shared_ptr<Expression> index, std::shared_ptr<Expression> expression) :
+	ArrayAssignment(Symbol variable, Expression * index, Expression * expression) :
 		variable(variable), index(index), expression(expression) {}
 
     virtual ~ArrayAssignment() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct StructAssignment : Statement
 {
-    std::string variable;
-    std::string member;
-    std::shared_ptr<Expression> expression;
+    Symbol variable;
+    Symbol member;
+    Expression * expression;
+    int slot = -1;
+    int index = -1;
 
-    StructAssignment(std::string variable, std::string member, std::shared_ptr<Expression> expression) :
+    StructAssignment(Symbol variable, Symbol member, Expression * expression) :
             variable(variable), member(member), expression(expression) {}
 
     virtual ~StructAssignment() = default;
 
     virtual llvm::Value * accept(Generator * generator);
+    virtual Type * check(TypeChecker * checker);
 };
 
 struct Return : Statement
 {
-	std::shared_ptr<Expression> expression;
+	Expression * expression;
 
-	Return(std::shared_ptr<Expression> expression) : expression(expression) {}
-	Return() : expression(std::shared_ptr<Expression>(nullptr)) {}
+	Return(Expression * expression) : expression(expression) {}
+	Return() : expression(nullptr) {}
 
     virtual ~Return() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct If : Statement
 {
-	std::shared_ptr<Expression> condition;
-	std::shared_ptr<Block> thenBlock;
-	std::shared_ptr<Block> elseBlock;
+	Expression * condition;
+	Block * thenBlock;
+	Block * elseBlock;
 
-	If(std::shared_ptr<Expression> condition, std::shared_ptr<Block> thenBlock, std::shared_ptr<Block> elseBlock) :
+	If(Expression * condition, Block * thenBlock, Block * elseBlock) :
 		condition(condition), thenBlock(thenBlock), elseBlock(elseBlock) {}
 
     virtual ~If() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+/**
+ * An arm of a match: the values it is taken for, each an Integer or a String, and its block.
+ */
+struct MatchCase
+{
+	std::vector<Expression *> values;
+	Block * block;
+};
+
+/**
+ * Runs the block of the case whose value an int, byte or string equals, or the else block
+ * if no case does. Cases do not fall through to the next one.
+ */
+struct Match : Statement
+{
+	Expression * subject = nullptr;
+	std::vector<MatchCase> cases;
+	Block * otherwise = nullptr;
+
+    virtual ~Match() = default;
+
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Print : Statement
 {
-	std::shared_ptr<Expression> expression;
+	Expression * expression;
 
-	Print(std::shared_ptr<Expression> expression) :
+	Print(Expression * expression) :
 		expression(expression) {}
 
     virtual ~Print() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct BinaryOp : Expression
 {
-	std::shared_ptr<Expression> left;
-	std::shared_ptr<Expression> right;
-	std::string op;
+	Expression * left;
+	Expression * right;
+	Operator op;
 
-	BinaryOp(std::shared_ptr<Expression> left, std::string op, std::shared_ptr<Expression> right) :
+	BinaryOp(Expression * left, Operator op, Expression * right) :
 		left(left), right(right), op(op) {}
 
     virtual ~BinaryOp() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+/**
+ * a && b, or a || b. The right side is only evaluated when the left one does not decide
+ * the result.
+ */
+struct Logical : Expression
+{
+	Expression * left;
+	Expression * right;
+
+	// true for &&, false for ||.
+	bool conjunction;
+
+	Logical(Expression * left, bool conjunction, Expression * right) :
+		left(left), right(right), conjunction(conjunction) {}
+
+    virtual ~Logical() = default;
+
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+struct Not : Expression
+{
+	Expression * operand;
+
+	Not(Expression * operand) : operand(operand) {}
+
+    virtual ~Not() = default;
+
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct FunctionCall : Expression
 {
-	std::string name;
-	std::string version;
-	std::vector<std::shared_ptr<Expression>> arguments;
+	Symbol name;
+	Symbol version;
+	Symbol virtualName;
+	std::vector<Expression *> arguments;
+
+	// the function called, or nullptr for a builtin.
+	Function * target = nullptr;
 
-	FunctionCall(std::string name, std::string version, std::vector<std::shared_ptr<Expression>> arguments) :
-		name(name), version(version), arguments(arguments) {}
+	FunctionCall(Symbol name, Symbol version, std::vector<Expression *> arguments) :
+		name(name), version(version), virtualName(Function::makeVirtualName(name, version)),
+		arguments(arguments) {}
 
     virtual ~FunctionCall() = default;
 
-	std::string getVirtualName()
+	Symbol getVirtualName()
 	{
-		if (version.empty()) {
-			return name;
-		}
-
-		return name + "." + version;
+		return virtualName;
 	}
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct VersionInv : Expression
 {
-	std::string version;
-	std::vector<std::shared_ptr<Expression>> arguments;
+	Symbol version;
+	std::vector<Expression *> arguments;
+	Function * target = nullptr;
 
-	VersionInv(std::string version, std::vector<std::shared_ptr<Expression>> arguments) :
+	VersionInv(Symbol version, std::vector<Expression *> arguments) :
 		version(version), arguments(arguments) {}
 
     virtual ~VersionInv() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 
-	std::string getVirtualName(std::string name)
+	Symbol getVirtualName(Symbol name)
 	{
-		if (version.empty()) {
-			return name;
-		}
-
-		return name + "." + version;
+		return Function::makeVirtualName(name, version);
 	}
 };
 
@@ -278,16 +416,19 @@ struct String : Expression
     virtual ~String() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Identifier : Expression
 {
-	std::string name;
+	Symbol name;
+	int slot = -1;
 
-	Identifier(std::string name) : name(name) {}
+	Identifier(Symbol name) : name(name) {}
     virtual ~Identifier() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Integer : Expression
@@ -298,6 +439,7 @@ struct Integer : Expression
     virtual ~Integer() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Bool : Expression
@@ -308,6 +450,7 @@ struct Bool : Expression
 	virtual ~Bool() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Float : Expression
@@ -318,63 +461,165 @@ struct Float : Expression
     virtual ~Float() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct Array : Expression
 {
-	std::vector<std::shared_ptr<Expression>> elements;
+	std::vector<Expression *> elements;
+	Storage storage = Storage::Stack;
 
-	Array(std::vector<std::shared_ptr<Expression>> elements) : elements(elements) {}
+	Array(std::vector<Expression *> elements) : elements(elements) {}
 
     virtual ~Array() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct ArrayIndex : Expression
 {
-	std::string name;
-	std::shared_ptr<Expression> expression;
+	Symbol name;
+	Expression * expression;
+	int slot = -1;
 
-	ArrayIndex(std::string name, std::shared_ptr<Expression> expression) :
+	ArrayIndex(Symbol name, Expression * expression) :
 		name(name), expression(expression) {}
 
     virtual ~ArrayIndex() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
 
 struct StructMember : Expression
 {
-    std::string variable;
-    std::string member;
+    Symbol variable;
+    Symbol member;
+    int slot = -1;
+    int index = -1;
 
-    StructMember(std::string variable, std::string member) :
+    StructMember(Symbol variable, Symbol member) :
             variable(variable), member(member) {}
 
     virtual ~StructMember() = default;
 
     virtual llvm::Value * accept(Generator * generator);
+    virtual Type * check(TypeChecker * checker);
 };
 
+/**
+ * Runs a call on the task threads. Its value is a task, which await turns into the result.
+ */
+struct Spawn : Expression
+{
+	FunctionCall * call;
 
-struct For : Statement
+	Spawn(FunctionCall * call) : call(call) {}
+
+    virtual ~Spawn() = default;
+
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+/**
+ * Waits for a task to finish and takes its result. A task is awaited once at most: awaiting
+ * a variable clears it, and tasks still in variables when the function returns are left to
+ * finish on their own.
+ */
+struct Await : Expression
 {
-	std::string variable;
-	std::shared_ptr<Expression> initial;
-	std::shared_ptr<Expression> condition;
-	std::shared_ptr<Expression> increment;
-	std::shared_ptr<Block> block;
+	Expression * task;
 
-	For(std::string variable, std::shared_ptr<Expression> initial, std::shared_ptr<Expression> condition,
-			std::shared_ptr<Block> block, std::shared_ptr<Expression> increment) :
-		variable(variable), initial(initial), condition(condition), increment(increment), block(block) {}
+	Await(Expression * task) : task(task) {}
+
+    virtual ~Await() = default;
 
-	For(std::string variable, std::shared_ptr<Expression> initial, std::shared_ptr<Expression> condition,
-			std::shared_ptr<Block> block) :
-		For(variable, initial, condition, block, std::make_shared<Integer>(1)) {}
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+struct For : Statement
+{
+	Symbol variable;
+	Expression * initial;
+	Expression * condition;
+	Expression * increment;
+	Block * block;
+	int slot = -1;
+
+	For(Symbol variable, Expression * initial, Expression * condition,
+			Block * block, Expression * increment) :
+		variable(variable), initial(initial), condition(condition), increment(increment), block(block) {}
 
     virtual ~For() = default;
 
 	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+/**
+ * Runs its block as long as the condition holds. A do-while runs it once before the
+ * condition is first tested.
+ */
+struct While : Statement
+{
+	Expression * condition;
+	Block * block;
+	bool first;
+
+	While(Expression * condition, Block * block, bool first) :
+		condition(condition), block(block), first(first) {}
+
+    virtual ~While() = default;
+
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+/**
+ * Counts a variable up from a bound to another one, which it never reaches, by a step that
+ * has to be positive: for i in from..to step 2. The bounds and the step are evaluated once,
+ * before the loop, so the number of rounds is known when the loop starts. Ranges that end
+ * near the largest int stop like any other.
+ */
+struct Range : Statement
+{
+	Symbol variable;
+	Expression * from;
+	Expression * to;
+	Expression * step;
+	Block * block;
+	int slot = -1;
+
+	Range(Symbol variable, Expression * from, Expression * to, Expression * step, Block * block) :
+		variable(variable), from(from), to(to), step(step), block(block) {}
+
+    virtual ~Range() = default;
+
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+/**
+ * Leaves the innermost loop.
+ */
+struct Break : Statement
+{
+    virtual ~Break() = default;
+
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
+};
+
+/**
+ * Goes on with the next round of the innermost loop.
+ */
+struct Continue : Statement
+{
+    virtual ~Continue() = default;
+
+	virtual llvm::Value * accept(Generator * generator);
+	virtual Type * check(TypeChecker * checker);
 };
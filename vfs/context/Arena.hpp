@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Bump allocator for the syntax tree of a compilation unit.
+ *
+ * Objects are never freed one by one: the arena runs their destructors and releases all of
+ * its memory at once when it is destroyed, so nodes can point to each other with raw pointers.
+ */
+class Arena
+{
+private:
+	static const size_t chunkSize = 64 * 1024;
+
+	struct Destructor
+	{
+		void * object;
+		void (*destroy)(void *);
+	};
+
+	std::vector<char *> chunks;
+
+	char * current = nullptr;
+	char * end = nullptr;
+
+	std::vector<Destructor> destructors;
+
+	size_t objects = 0;
+
+	static char * align(char * pointer, size_t alignment)
+	{
+		auto address = reinterpret_cast<std::uintptr_t>(pointer);
+		return reinterpret_cast<char *>((address + alignment - 1) & ~(alignment - 1));
+	}
+
+	void * allocate(size_t size, size_t alignment)
+	{
+		char * pointer = align(current, alignment);
+
+		if (current == nullptr || pointer + size > end) {
+			size_t capacity = size + alignment > chunkSize ? size + alignment : chunkSize;
+
+			current = static_cast<char *>(std::malloc(capacity));
+
+			if (current == nullptr) {
+				throw std::bad_alloc();
+			}
+
+			chunks.push_back(current);
+			end = current + capacity;
+			pointer = align(current, alignment);
+		}
+
+		current = pointer + size;
+		return pointer;
+	}
+
+public:
+	Arena() = default;
+
+	Arena(const Arena &) = delete;
+	Arena & operator=(const Arena &) = delete;
+
+	~Arena()
+	{
+		// destroy in reverse order, like the stack would.
+		for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+			it->destroy(it->object);
+		}
+
+		for (auto chunk : chunks) {
+			std::free(chunk);
+		}
+	}
+
+	/**
+	 * Constructs an object in the arena. It lives as long as the arena does.
+	 */
+	template<typename T, typename... Args>
+	T * make(Args &&... args)
+	{
+		T * object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+		if (!std::is_trivially_destructible<T>::value) {
+			destructors.push_back({ object, [](void * o) { static_cast<T *>(o)->~T(); } });
+		}
+
+		objects++;
+		return object;
+	}
+
+	/**
+	 * @return the number of objects made in this arena.
+	 */
+	size_t size() const
+	{
+		return objects;
+	}
+};
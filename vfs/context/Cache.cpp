@@ -0,0 +1,118 @@
+#include "Cache.hpp"
+
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+
+Cache::Cache(std::string directory) : directory(directory)
+{
+    if (llvm::sys::fs::create_directories(directory)) {
+        throw std::runtime_error("Cannot create cache directory: " + directory);
+    }
+}
+
+std::string Cache::getPath(std::string key, std::string extension)
+{
+    return directory + "/" + key + extension;
+}
+
+void Cache::write(std::string path, llvm::StringRef data)
+{
+    // write to a private file and rename it, so concurrent builds never read a partial entry.
+    auto temporary = path + ".tmp." + std::to_string(getpid());
+
+    {
+        std::error_code error;
+        llvm::raw_fd_ostream out(temporary, error, llvm::sys::fs::F_None);
+
+        if (error) {
+            return;
+        }
+
+        out << data;
+    }
+
+    if (llvm::sys::fs::rename(temporary, path)) {
+        llvm::sys::fs::remove(temporary);
+    }
+}
+
+std::string Cache::hash(llvm::StringRef data)
+{
+    llvm::MD5 md5;
+    md5.update(data);
+
+    llvm::MD5::MD5Result result;
+    md5.final(result);
+
+    llvm::SmallString<32> digest;
+    llvm::MD5::stringifyResult(result, digest);
+
+    return digest.str().str();
+}
+
+bool Cache::getImports(std::string hash, std::vector<std::string> & imports)
+{
+    std::ifstream in(getPath(hash, ".imports"));
+
+    if (!in) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        imports.push_back(line);
+    }
+
+    return true;
+}
+
+void Cache::putImports(std::string hash, const std::vector<std::string> & imports)
+{
+    std::string data;
+
+    for (auto & i : imports) {
+        data += i + "\n";
+    }
+
+    write(getPath(hash, ".imports"), data);
+}
+
+std::unique_ptr<llvm::Module> Cache::getModule(std::string key, llvm::LLVMContext & context)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(getPath(key, ".bc"));
+
+    if (!buffer) {
+        return nullptr;
+    }
+
+    auto module = llvm::parseBitcodeFile(buffer.get()->getMemBufferRef(), context);
+
+    if (!module) {
+        // a corrupted entry is just a miss, it will be overwritten.
+        return nullptr;
+    }
+
+    return std::unique_ptr<llvm::Module>(module.get());
+}
+
+void Cache::putModule(std::string key, llvm::Module * module)
+{
+    std::string data;
+
+    {
+        llvm::raw_string_ostream out(data);
+        llvm::WriteBitcodeToFile(module, out);
+    }
+
+    write(getPath(key, ".bc"), data);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+/**
+ * Persistent on-disk cache of compiled units.
+ *
+ * Entries are content addressed: the imports of a source are stored under the hash of its
+ * text, and its bitcode under a key that also covers the text of everything it imports, so
+ * a stale entry is never looked up and nothing has to be invalidated.
+ */
+class Cache
+{
+private:
+	std::string directory;
+
+	std::string getPath(std::string key, std::string extension);
+
+	void write(std::string path, llvm::StringRef data);
+
+public:
+	Cache(std::string directory);
+
+	/**
+	 * @return the hex digest of the given data.
+	 */
+	static std::string hash(llvm::StringRef data);
+
+	/**
+	 * Looks up the (unresolved) imports of the source with the given content hash.
+	 *
+	 * @return true if they were found.
+	 */
+	bool getImports(std::string hash, std::vector<std::string> & imports);
+
+	void putImports(std::string hash, const std::vector<std::string> & imports);
+
+	/**
+	 * @return the module stored under the given key, or null if there is none.
+	 */
+	std::unique_ptr<llvm::Module> getModule(std::string key, llvm::LLVMContext & context);
+
+	void putModule(std::string key, llvm::Module * module);
+};
@@ -0,0 +1,59 @@
+#include "Profile.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "Cache.hpp"
+
+
+std::unique_ptr<Profile> Profile::read(std::string path)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+
+    if (!buffer) {
+        throw std::runtime_error("Cannot read profile: " + path);
+    }
+
+    std::unique_ptr<Profile> profile(new Profile());
+    profile->hash = Cache::hash(buffer.get()->getBuffer());
+
+    std::istringstream in(buffer.get()->getBuffer().str());
+    std::string name;
+    Function function;
+    size_t size;
+
+    while (in >> name >> function.hash >> size) {
+        function.counters.resize(size);
+
+        for (auto & counter : function.counters) {
+            if (!(in >> counter)) {
+                throw std::runtime_error("Malformed profile: " + path);
+            }
+        }
+
+        if (!function.counters.empty() && function.counters[0] > profile->maxEntryCount) {
+            profile->maxEntryCount = function.counters[0];
+        }
+
+        profile->functions[name] = function;
+    }
+
+    if (!in.eof()) {
+        throw std::runtime_error("Malformed profile: " + path);
+    }
+
+    return profile;
+}
+
+const Profile::Function * Profile::get(const std::string & name, uint64_t hash, size_t size) const
+{
+    auto it = functions.find(name);
+
+    if (it == functions.end() || it->second.hash != hash || it->second.counters.size() != size) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
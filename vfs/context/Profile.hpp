@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Counters written by a program compiled with -fprofile-generate, read back for -fprofile-use.
+ *
+ * The counters of a function are its entry count followed, for each of its conditional
+ * branches in the order they were generated, by how many times the branch was evaluated
+ * and how many times it was taken.
+ */
+class Profile
+{
+public:
+	struct Function
+	{
+		// describes the branches the counters were made for.
+		uint64_t hash;
+		std::vector<uint64_t> counters;
+	};
+
+private:
+	std::unordered_map<std::string, Function> functions;
+
+	uint64_t maxEntryCount = 0;
+
+public:
+	// hash of the profile text, so cached modules generated with another profile are not used.
+	std::string hash;
+
+	/**
+	 * Reads a profile file. Throws if it cannot be read.
+	 */
+	static std::unique_ptr<Profile> read(std::string path);
+
+	/**
+	 * @return the counters of a function, or null if they are missing or were made for
+	 * different branches.
+	 */
+	const Function * get(const std::string & name, uint64_t hash, size_t size) const;
+
+	/**
+	 * @return whether a function is entered often enough to be worth inlining.
+	 */
+	bool isHot(uint64_t entryCount) const
+	{
+		return entryCount > 0 && entryCount * 100 >= maxEntryCount;
+	}
+};
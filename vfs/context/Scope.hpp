@@ -1,40 +1,43 @@
 #pragma once
 
-#include <llvm/IR/Value.h>
+#include <stdexcept>
+#include <unordered_map>
 
-#include <map>
+#include "Symbol.hpp"
 
+/**
+ * Maps the names visible in a block to the slots of their variables.
+ */
 class Scope
 {
 private:
-	std::map<std::string, llvm::Value*> table;
+	std::unordered_map<Symbol, int> table;
 
     Scope * parent;
 
 public:
     Scope(Scope * parent) : parent(parent) {}
 
-	void add(std::string name, llvm::Value * value)
+	void add(Symbol name, int slot)
 	{
-		if (table.find(name) != table.end()) {
-			throw std::runtime_error("Symbol already declared: " + name);
+		if (!table.insert(std::make_pair(name, slot)).second) {
+			throw std::runtime_error("Symbol already declared: " + name.str());
 		}
-
-		table[name] = value;
 	}
 
-	llvm::Value * get(std::string name)
+	/**
+	 * @return the slot of the variable, or -1 if it is not declared.
+	 */
+	int get(Symbol name)
 	{
-		auto it = table.find(name);
+		for (Scope * scope = this; scope != nullptr; scope = scope->parent) {
+			auto it = scope->table.find(name);
 
-		if (it != table.end()) {
-			return it->second;
+			if (it != scope->table.end()) {
+				return it->second;
+			}
 		}
 
-        if (parent != nullptr) {
-            return parent->get(name);
-        } else {
-            return nullptr;
-        }
+		return -1;
 	}
 };
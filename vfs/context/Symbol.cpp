@@ -0,0 +1,88 @@
+#include "Symbol.hpp"
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include <llvm/ADT/Hashing.h>
+
+namespace
+{
+
+struct StringRefHash
+{
+    size_t operator()(llvm::StringRef text) const
+    {
+        return llvm::hash_value(text);
+    }
+};
+
+/**
+ * A part of the table of interned names. Strings live in a deque, which never moves them, and
+ * the index refers to them, so lookups never allocate.
+ */
+struct Shard
+{
+    std::mutex mutex;
+
+    std::deque<std::string> strings;
+
+    std::unordered_map<llvm::StringRef, const std::string *, StringRefHash> index;
+};
+
+/**
+ * Names are spread over shards by hash, so threads interning different names rarely wait for
+ * each other. Symbols are compared across units and compiles, so names are never freed; there
+ * are only as many as distinct identifiers.
+ */
+const size_t shardCount = 16;
+
+Shard & getShard(size_t hash)
+{
+    static Shard shards[shardCount];
+    return shards[hash % shardCount];
+}
+
+/**
+ * The names this thread already interned, found without taking any lock. Its keys refer to
+ * the interned strings, which outlive it.
+ */
+std::unordered_map<llvm::StringRef, const std::string *, StringRefHash> & getSeen()
+{
+    static thread_local std::unordered_map<llvm::StringRef, const std::string *, StringRefHash> seen;
+    return seen;
+}
+
+}
+
+Symbol Symbol::get(llvm::StringRef text)
+{
+    auto & seen = getSeen();
+    auto known = seen.find(text);
+
+    if (known != seen.end()) {
+        return Symbol(known->second);
+    }
+
+    auto & shard = getShard(StringRefHash()(text));
+    const std::string * entry;
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(text);
+
+        if (it != shard.index.end()) {
+            entry = it->second;
+        } else {
+            shard.strings.push_back(text.str());
+
+            entry = &shard.strings.back();
+            shard.index[llvm::StringRef(*entry)] = entry;
+        }
+    }
+
+    seen[llvm::StringRef(*entry)] = entry;
+
+    return Symbol(entry);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <llvm/ADT/StringRef.h>
+
+/**
+ * An interned identifier.
+ *
+ * Every distinct name is stored once for the whole process, so symbols compare and hash as
+ * pointers. The default constructor is trivial, so symbols can live in the parser's value
+ * union; such a symbol is meaningless until something is assigned to it.
+ */
+class Symbol
+{
+private:
+	const std::string * entry;
+
+	explicit Symbol(const std::string * entry) : entry(entry) {}
+
+public:
+	Symbol() = default;
+
+	/**
+	 * @return the symbol for the given text, interning it if it was never seen before.
+	 */
+	static Symbol get(llvm::StringRef text);
+
+	const std::string & str() const
+	{
+		return *entry;
+	}
+
+	bool empty() const
+	{
+		return entry->empty();
+	}
+
+	bool operator==(Symbol other) const
+	{
+		return entry == other.entry;
+	}
+
+	bool operator!=(Symbol other) const
+	{
+		return entry != other.entry;
+	}
+
+	bool operator<(Symbol other) const
+	{
+		return entry < other.entry;
+	}
+
+	size_t hash() const
+	{
+		return std::hash<const std::string *>()(entry);
+	}
+};
+
+namespace std
+{
+	template<>
+	struct hash<Symbol>
+	{
+		size_t operator()(Symbol symbol) const
+		{
+			return symbol.hash();
+		}
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <set>
+
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "../ast/SyntaxTree.hpp"
+#include "Arena.hpp"
+
+/**
+ * A compilation unit: one source file, its top level definitions and the units it imports.
+ *
+ * Every unit is generated into its own module; the modules are linked together afterwards.
+ */
+struct Unit
+{
+	std::string path;
+
+	// hash of the source text of the unit alone.
+	std::string hash;
+
+	// cache key of the generated code: the hash, the hashes of its imports and the options.
+	std::string key;
+
+	// text of the unit, usually a mapping of the file, kept until it is parsed.
+	std::unique_ptr<llvm::MemoryBuffer> source;
+
+	// a unit found in the cache is only parsed when another unit needs its declarations.
+	bool parsed = false;
+
+	// the syntax tree of the unit lives in its arena.
+	std::unique_ptr<Arena> arena;
+
+	std::vector<Function *> program;
+	std::vector<Struct *> structs;
+
+	// imported units are owned by the driver, which outlives them.
+	std::vector<Unit *> imports;
+
+	Unit(std::string path) : path(path) {}
+
+	/**
+	 * Resolves an import path relative to the directory of the importing file.
+	 */
+	static std::string resolve(std::string from, std::string path)
+	{
+		if (!path.empty() && path[0] == '/') {
+			return path;
+		}
+
+		auto slash = from.find_last_of('/');
+
+		if (slash == std::string::npos) {
+			return path;
+		}
+
+		return from.substr(0, slash + 1) + path;
+	}
+
+	/**
+	 * @return every unit reachable through imports, dependencies first, without this unit.
+	 */
+	std::vector<Unit *> getDependencies()
+	{
+		std::vector<Unit *> result;
+		std::set<Unit *> visited = { this };
+
+		collect(visited, result);
+
+		return result;
+	}
+
+private:
+	void collect(std::set<Unit *> & visited, std::vector<Unit *> & result)
+	{
+		for (auto unit : imports) {
+			if (visited.insert(unit).second) {
+				unit->collect(visited, result);
+				result.push_back(unit);
+			}
+		}
+	}
+};
@@ -0,0 +1,526 @@
+#include "Compiler.hpp"
+
+#include <exception>
+#include <thread>
+#include <unordered_map>
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+#include "../ast/Generator.hpp"
+#include "../parser/ParseContext.hpp"
+#include "../sema/TypeChecker.hpp"
+#include "../type/Types.hpp"
+
+namespace vfs
+{
+
+static GeneratorOptions getGeneratorOptions(const CompilerOptions & options, const Profile * profile)
+{
+    GeneratorOptions generatorOptions;
+    generatorOptions.instrument = options.instrument;
+    generatorOptions.profileGenerate = options.profileGenerate;
+    generatorOptions.profile = profile;
+
+    return generatorOptions;
+}
+
+Compiler::Compiler(CompilerOptions options) : options(options)
+{
+    report.timePhases = options.timeReport;
+    report.timeFunctions = options.timeFunctions;
+    report.stats = options.stats;
+
+    if (!options.cacheDirectory.empty()) {
+        cache.reset(new Cache(options.cacheDirectory));
+    }
+
+    if (!options.profileUse.empty()) {
+        profile = Profile::read(options.profileUse);
+    }
+}
+
+std::unique_ptr<llvm::Module> Compiler::compile(std::vector<std::string> paths)
+{
+    units.clear();
+    order.clear();
+
+    for (auto & path : paths) {
+        find(path);
+    }
+
+    return link();
+}
+
+std::unique_ptr<llvm::Module> Compiler::compileSource(std::string name, std::string source)
+{
+    units.clear();
+    order.clear();
+
+    add(name, name, llvm::MemoryBuffer::getMemBufferCopy(source, name));
+
+    return link();
+}
+
+std::vector<std::string> Compiler::parse(Unit * unit)
+{
+    Report::Phase phase(report, "Parse");
+
+    unit->arena.reset(new Arena());
+    ParseContext parseContext(unit->arena.get());
+
+    try {
+        ::parse(unit->source->getBuffer(), parseContext);
+    } catch (const std::exception & e) {
+        throw CompileError("Syntax", unit->path + ": " + e.what());
+    }
+
+    report.count("AST nodes", unit->arena->size());
+
+    unit->program = std::move(parseContext.program);
+    unit->structs = std::move(parseContext.structs);
+    unit->parsed = true;
+
+    // the text is not needed anymore.
+    unit->source.reset();
+
+    return parseContext.imports;
+}
+
+Unit * Compiler::find(std::string path)
+{
+    char canonical[PATH_MAX];
+
+    if (realpath(path.c_str(), canonical) == nullptr) {
+        throw CompileError("Syntax", "Cannot open source file: " + path);
+    }
+
+    auto it = units.find(canonical);
+
+    if (it != units.end()) {
+        return it->second.get();
+    }
+
+    // large files are mapped rather than read.
+    auto source = llvm::MemoryBuffer::getFile(canonical);
+
+    if (!source) {
+        throw CompileError("Syntax", "Cannot read source file: " + path);
+    }
+
+    return add(path, canonical, std::move(source.get()));
+}
+
+Unit * Compiler::add(std::string path, std::string canonical, std::unique_ptr<llvm::MemoryBuffer> source)
+{
+    report.count("units");
+    report.count("source bytes", source->getBufferSize());
+
+    auto unit = std::make_shared<Unit>(path);
+    unit->hash = Cache::hash(source->getBuffer());
+    unit->source = std::move(source);
+
+    units[canonical] = unit;
+    order.push_back(unit.get());
+
+    // a source whose imports are known from the cache is not parsed here.
+    std::vector<std::string> imports;
+
+    if (!cache || !cache->getImports(unit->hash, imports)) {
+        // a streamed unit is parsed when it is generated, here only its imports are needed.
+        if (options.stream) {
+            Report::Phase phase(report, "Find imports");
+            imports = findImports(unit->source->getBuffer());
+        } else {
+            imports = parse(unit.get());
+        }
+
+        if (cache) {
+            cache->putImports(unit->hash, imports);
+        }
+    }
+
+    for (auto & i : imports) {
+        unit->imports.push_back(find(Unit::resolve(path, i)));
+    }
+
+    return unit.get();
+}
+
+void Compiler::check(Unit * unit, const std::vector<Unit *> & dependencies)
+{
+    Report::Phase phase(report, "Type check");
+
+    TypeChecker checker(*unit->arena);
+
+    try {
+        for (auto dependency : dependencies) {
+            checker.declare(dependency->program, dependency->structs);
+        }
+
+        checker.check(unit->program, unit->structs);
+    } catch (const std::exception & e) {
+        throw CompileError("Type", unit->path + ": " + e.what());
+    }
+}
+
+std::unique_ptr<llvm::Module> Compiler::generate(Unit * unit, std::vector<Unit *> dependencies)
+{
+    Report::Phase phase(report, "Generate");
+
+    if (options.jobs <= 1 || unit->program.size() <= 1) {
+        Generator generator(context, unit->path, getGeneratorOptions(options, profile.get()));
+
+        for (auto dependency : dependencies) {
+            generator.declare(dependency->program, dependency->structs);
+        }
+
+        generator.declare(unit->program, unit->structs);
+
+        for (auto function : unit->program) {
+            Report::FunctionPhase functionPhase(report, function->getVirtualName().str());
+            generator.define({ function });
+        }
+
+        return generator.release();
+    }
+
+    // the functions are split in partitions, each one generated on its own thread with its own
+    // context. The partitions travel to this context as bitcode, and are linked here.
+    auto count = std::min<size_t>(options.jobs, unit->program.size());
+
+    std::vector<std::vector<Function *>> partitions(count);
+    for (size_t i = 0; i < unit->program.size(); i++) {
+        partitions[i % count].push_back(unit->program[i]);
+    }
+
+    std::vector<std::string> bitcode(count);
+    std::vector<std::exception_ptr> errors(count);
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < count; i++) {
+        workers.push_back(std::thread([&, i]() {
+            try {
+                llvm::LLVMContext partitionContext;
+                Generator generator(partitionContext, unit->path, getGeneratorOptions(options, profile.get()));
+
+                for (auto dependency : dependencies) {
+                    generator.declare(dependency->program, dependency->structs);
+                }
+
+                generator.declare(unit->program, unit->structs);
+                generator.define(partitions[i]);
+
+                auto module = generator.release();
+
+                llvm::raw_string_ostream out(bitcode[i]);
+                llvm::WriteBitcodeToFile(module.get(), out);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }));
+    }
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    for (auto & error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    std::unique_ptr<llvm::Module> module;
+
+    for (size_t i = 0; i < count; i++) {
+        auto buffer = llvm::MemoryBufferRef(bitcode[i], unit->path);
+        auto partition = llvm::parseBitcodeFile(buffer, context);
+
+        if (!partition) {
+            throw std::runtime_error("Cannot read partition of " + unit->path);
+        }
+
+        if (!module) {
+            module.reset(partition.get());
+        } else {
+            std::unique_ptr<llvm::Module> owner(partition.get());
+
+            if (llvm::Linker::LinkModules(module.get(), owner.get())) {
+                throw std::runtime_error("Cannot link partitions of " + unit->path);
+            }
+        }
+    }
+
+    return module;
+}
+
+/**
+ * @return a body-less copy of a function, which is all its callers need.
+ */
+static Function * declaration(Function * function, Arena & arena)
+{
+    std::vector<Parameter *> parameters;
+
+    for (auto parameter : function->parameters) {
+        parameters.push_back(arena.make<Parameter>(parameter->name, parameter->type->clone(arena)));
+    }
+
+    auto copy = arena.make<Function>(function->name, function->version, parameters,
+            function->type->clone(arena), function->isImported() ? nullptr : arena.make<Block>());
+
+    copy->external = function->external;
+    copy->escapingParameters = function->escapingParameters;
+
+    return copy;
+}
+
+std::unique_ptr<llvm::Module> Compiler::stream(Unit * unit, const std::vector<Unit *> & dependencies)
+{
+    // parsing, checking and generating are interleaved, so they are timed as one phase.
+    Report::Phase phase(report, "Stream");
+
+    // structs and the declarations of generated functions outlive the parse in the unit arena,
+    // every other definition is parsed into an arena of its own, freed once it is generated.
+    unit->arena.reset(new Arena());
+
+    TypeChecker checker(*unit->arena);
+    Generator generator(context, unit->path, getGeneratorOptions(options, profile.get()));
+
+    for (auto dependency : dependencies) {
+        checker.declare(dependency->program, dependency->structs);
+        generator.declare(dependency->program, dependency->structs);
+    }
+
+    struct Pending
+    {
+        Function * function;
+        std::unique_ptr<Arena> arena;
+    };
+
+    // functions that call something not declared yet wait for it, by name.
+    std::unordered_map<Symbol, std::vector<std::shared_ptr<Pending>>> waiting;
+
+    std::vector<std::unique_ptr<Arena>> structArenas;
+    std::unique_ptr<Arena> arena(new Arena());
+
+    ParseContext parseContext(arena.get());
+
+    auto define = [&](std::shared_ptr<Pending> pending) {
+        try {
+            pending->function->check(&checker);
+        } catch (const UndeclaredFunction & e) {
+            waiting[e.name].push_back(pending);
+            return;
+        } catch (const std::exception & e) {
+            throw CompileError("Type", unit->path + ": " + e.what());
+        }
+
+        try {
+            Report::FunctionPhase functionPhase(report, pending->function->getVirtualName().str());
+            generator.define({ pending->function });
+        } catch (const std::exception & e) {
+            throw CompileError("Generation", unit->path + ": " + e.what());
+        }
+
+        checker.redeclare(declaration(pending->function, *unit->arena));
+
+        report.count("AST nodes", pending->arena->size());
+        pending->arena.reset();
+    };
+
+    parseContext.onStruct = [&](Struct * structDef) {
+        checker.declare({}, { structDef });
+        generator.declare({}, { structDef });
+
+        report.count("AST nodes", arena->size());
+        structArenas.push_back(std::move(arena));
+        arena.reset(new Arena());
+        parseContext.arena = arena.get();
+    };
+
+    parseContext.onFunction = [&](Function * function) {
+        // the function may be freed by define.
+        auto name = function->getVirtualName();
+
+        auto pending = std::make_shared<Pending>();
+        pending->function = function;
+        pending->arena = std::move(arena);
+
+        arena.reset(new Arena());
+        parseContext.arena = arena.get();
+
+        try {
+            checker.declare({ function }, {});
+            generator.declare({ function }, {});
+        } catch (const std::exception & e) {
+            throw CompileError("Type", unit->path + ": " + e.what());
+        }
+
+        define(pending);
+
+        // the functions that were waiting for this one can go on.
+        auto it = waiting.find(name);
+
+        if (it != waiting.end()) {
+            auto resumed = std::move(it->second);
+            waiting.erase(it);
+
+            for (auto & i : resumed) {
+                define(i);
+            }
+        }
+    };
+
+    try {
+        ::parse(unit->source->getBuffer(), parseContext);
+    } catch (const CompileError &) {
+        throw;
+    } catch (const std::exception & e) {
+        throw CompileError("Syntax", unit->path + ": " + e.what());
+    }
+
+    if (!waiting.empty()) {
+        throw CompileError("Type", unit->path + ": Function not defined: "
+                + waiting.begin()->first.str());
+    }
+
+    return generator.release();
+}
+
+std::unique_ptr<llvm::Module> Compiler::link()
+{
+    std::vector<std::unique_ptr<llvm::Module>> modules;
+
+    try {
+        for (auto unit : order) {
+            // the generated code depends on the declarations of every import.
+            auto dependencies = unit->getDependencies();
+
+            std::string key = unit->hash;
+            for (auto dependency : dependencies) {
+                key += dependency->hash;
+            }
+
+            // so is whether it is instrumented or profiled.
+            if (options.instrument) {
+                key += "instrument";
+            }
+
+            if (!options.profileGenerate.empty()) {
+                key += "profile-generate:" + options.profileGenerate;
+            }
+
+            if (profile) {
+                key += "profile-use:" + profile->hash;
+            }
+
+            unit->key = Cache::hash(key);
+
+            if (cache) {
+                Report::Phase phase(report, "Cache");
+                auto module = cache->getModule(unit->key, context);
+
+                if (module) {
+                    report.count("cache hits");
+                    modules.push_back(std::move(module));
+                    continue;
+                }
+            }
+
+            for (auto dependency : dependencies) {
+                if (!dependency->parsed) {
+                    parse(dependency);
+                }
+            }
+
+            std::unique_ptr<llvm::Module> module;
+
+            if (options.stream && !unit->parsed) {
+                module = stream(unit, dependencies);
+            } else {
+                if (!unit->parsed) {
+                    parse(unit);
+                }
+
+                check(unit, dependencies);
+
+                module = generate(unit, dependencies);
+            }
+
+            if (cache) {
+                Report::Phase phase(report, "Cache");
+                cache->putModule(unit->key, module.get());
+            }
+
+            modules.push_back(std::move(module));
+        }
+    } catch (const CompileError &) {
+        throw;
+    } catch (const std::exception & e) {
+        throw CompileError("Generation", e.what());
+    }
+
+    if (modules.empty()) {
+        return nullptr;
+    }
+
+    {
+        Report::Phase phase(report, "Link");
+
+        // link every unit into the first one.
+        llvm::Linker linker(modules[0].get());
+
+        for (size_t i = 1; i < modules.size(); i++) {
+            if (linker.linkInModule(modules[i].get())) {
+                throw CompileError("Link", order[i]->path);
+            }
+        }
+    }
+
+    if (options.optimize > 0) {
+        Report::Phase phase(report, "Optimize");
+        optimize(modules[0].get());
+    }
+
+    report.count(modules[0].get());
+
+    return std::move(modules[0]);
+}
+
+void Compiler::optimize(llvm::Module * module)
+{
+    llvm::PassManagerBuilder builder;
+    builder.OptLevel = options.optimize;
+
+    // the inliner follows the hints of -fprofile-use: hot functions are inlined more, cold ones less.
+    if (options.optimize > 1) {
+        builder.Inliner = llvm::createFunctionInliningPass(options.optimize, 0);
+    }
+
+    llvm::legacy::FunctionPassManager functionPasses(module);
+    llvm::legacy::PassManager modulePasses;
+
+    builder.populateFunctionPassManager(functionPasses);
+    builder.populateModulePassManager(modulePasses);
+
+    functionPasses.doInitialization();
+
+    for (auto & function : *module) {
+        functionPasses.run(function);
+    }
+
+    functionPasses.doFinalization();
+
+    modulePasses.run(*module);
+}
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#include "../context/Cache.hpp"
+#include "../context/Profile.hpp"
+#include "../context/Unit.hpp"
+#include "Report.hpp"
+
+namespace vfs
+{
+
+/**
+ * An error found while compiling, along with the stage that found it: "Syntax", "Type",
+ * "Generation" or "Link".
+ */
+struct CompileError : std::runtime_error
+{
+	std::string stage;
+
+	CompileError(std::string stage, std::string message) :
+		std::runtime_error(message), stage(stage) {}
+};
+
+struct CompilerOptions
+{
+	// directory of the unit cache, or empty to compile everything.
+	std::string cacheDirectory;
+
+	// number of threads that generate the functions of a unit.
+	unsigned jobs = 1;
+
+	// generate each function as soon as it is parsed, and free its tree right after, so
+	// memory grows with the largest function instead of with the whole source.
+	bool stream = false;
+
+	// print the time and peak memory of each phase, the time of each generated function,
+	// and counters of what was produced, once compilation is done.
+	bool timeReport = false;
+	bool timeFunctions = false;
+	bool stats = false;
+
+	// emit calls to the profiler runtime, which prints call counts, cycles and loop
+	// iterations per function when the program exits. Programs have to link libvfsrt.
+	bool instrument = false;
+
+	// make programs count their branches into this file (-fprofile-generate), or weight
+	// branches and inlining with the counts of an earlier run (-fprofile-use).
+	std::string profileGenerate;
+	std::string profileUse;
+
+	// optimization level of the linked module, from 0 to 3.
+	unsigned optimize = 0;
+};
+
+/**
+ * Compiles VFS sources into LLVM modules.
+ *
+ * A compiler owns its LLVMContext and keeps no global state, so hosts can compile on many
+ * threads at once with one compiler per thread. A single compiler is not meant to be used
+ * from several threads at the same time.
+ */
+class Compiler
+{
+private:
+	CompilerOptions options;
+
+	llvm::LLVMContext context;
+
+	std::unique_ptr<Cache> cache;
+
+	Report report;
+
+	std::unique_ptr<Profile> profile;
+
+	// every unit of the current compilation, by canonical path, in the order they were found.
+	std::map<std::string, std::shared_ptr<Unit>> units;
+	std::vector<Unit *> order;
+
+	/**
+	 * Parses the source of a unit.
+	 *
+	 * @return the imports of the unit, as written in the source.
+	 */
+	std::vector<std::string> parse(Unit * unit);
+
+	/**
+	 * Finds the unit of a source file, adding it if this is the first time it is seen.
+	 */
+	Unit * find(std::string path);
+
+	/**
+	 * Adds a unit and, recursively, the units it imports.
+	 */
+	Unit * add(std::string path, std::string canonical, std::unique_ptr<llvm::MemoryBuffer> source);
+
+	/**
+	 * Type checks a parsed unit against the declarations of its dependencies.
+	 */
+	void check(Unit * unit, const std::vector<Unit *> & dependencies);
+
+	std::unique_ptr<llvm::Module> generate(Unit * unit, std::vector<Unit *> dependencies);
+
+	/**
+	 * Parses, checks and generates a unit one top level definition at a time.
+	 */
+	std::unique_ptr<llvm::Module> stream(Unit * unit, const std::vector<Unit *> & dependencies);
+
+	std::unique_ptr<llvm::Module> link();
+
+	void optimize(llvm::Module * module);
+
+public:
+	Compiler(CompilerOptions options = CompilerOptions());
+
+	/**
+	 * Compiles the given source files, and everything they import, into a single module.
+	 *
+	 * The module belongs to the context of this compiler, and must not outlive it.
+	 */
+	std::unique_ptr<llvm::Module> compile(std::vector<std::string> paths);
+
+	/**
+	 * Compiles a source that is already in memory. Its imports are resolved relative to name.
+	 */
+	std::unique_ptr<llvm::Module> compileSource(std::string name, std::string source);
+
+	llvm::LLVMContext & getContext()
+	{
+		return context;
+	}
+
+	const CompilerOptions & getOptions() const
+	{
+		return options;
+	}
+
+	/**
+	 * @return the timers and counters of this compiler, which add up across compilations.
+	 */
+	Report & getReport()
+	{
+		return report;
+	}
+};
+
+}
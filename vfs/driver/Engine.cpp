@@ -0,0 +1,128 @@
+#include "Engine.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/TargetSelect.h>
+
+namespace vfs
+{
+
+static std::once_flag initialized;
+
+static void initialize()
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    // so compiled code finds the runtime and the C functions it imports in the host.
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+}
+
+/**
+ * @return the letter of a type in a signature, see NativeType.
+ */
+static char describe(llvm::Type * type)
+{
+    if (type->isVoidTy()) {
+        return 'v';
+    } else if (type->isIntegerTy(1)) {
+        return 'b';
+    } else if (type->isIntegerTy(8)) {
+        return 'c';
+    } else if (type->isIntegerTy(32)) {
+        return 'i';
+    } else if (type->isFloatTy()) {
+        return 'f';
+    } else if (type->isDoubleTy()) {
+        return 'd';
+    } else if (type->isPointerTy()) {
+        return 'p';
+    }
+
+    return '?';
+}
+
+Program::Program(std::unique_ptr<Compiler> compiler, std::unique_ptr<llvm::Module> module) :
+        compiler(std::move(compiler)), module(module.get())
+{
+    std::call_once(initialized, initialize);
+
+    std::string error;
+    unsigned level = std::min(this->compiler->getOptions().optimize, 3u);
+
+    engine.reset(llvm::EngineBuilder(std::move(module))
+            .setErrorStr(&error)
+            .setEngineKind(llvm::EngineKind::JIT)
+            .setOptLevel((llvm::CodeGenOpt::Level) level)
+            .setMCJITMemoryManager(std::unique_ptr<llvm::SectionMemoryManager>(new llvm::SectionMemoryManager()))
+            .create());
+
+    if (!engine) {
+        throw CompileError("Generation", "Cannot create the JIT: " + error);
+    }
+
+    engine->finalizeObject();
+
+    // registers profile counters, for programs compiled with -fprofile-generate.
+    engine->runStaticConstructorsDestructors(false);
+}
+
+Program::~Program()
+{
+    engine->runStaticConstructorsDestructors(true);
+}
+
+void * Program::getAddress(const std::string & name, const std::string & signature)
+{
+    auto function = module->getFunction(name == "Main" ? "main" : name);
+
+    if (function == nullptr || function->isDeclaration()) {
+        throw std::runtime_error("Function not defined: " + name);
+    }
+
+    std::string actual(1, describe(function->getReturnType()));
+
+    for (auto & argument : function->args()) {
+        actual.push_back(describe(argument.getType()));
+    }
+
+    if (actual != signature) {
+        throw std::runtime_error("Function " + name + " has signature " + actual + ", not " + signature);
+    }
+
+    return reinterpret_cast<void *>(engine->getFunctionAddress(function->getName().str()));
+}
+
+Engine::Engine(CompilerOptions options) : options(options)
+{
+}
+
+void Engine::install(std::unique_ptr<Compiler> compiler, std::unique_ptr<llvm::Module> module)
+{
+    auto program = std::make_shared<Program>(std::move(compiler), std::move(module));
+
+    // the old program is freed by whoever releases it last.
+    std::atomic_store(&current, program);
+}
+
+void Engine::load(std::vector<std::string> paths)
+{
+    std::unique_ptr<Compiler> compiler(new Compiler(options));
+    auto module = compiler->compile(paths);
+
+    install(std::move(compiler), std::move(module));
+}
+
+void Engine::loadSource(std::string name, std::string source)
+{
+    std::unique_ptr<Compiler> compiler(new Compiler(options));
+    auto module = compiler->compileSource(name, source);
+
+    install(std::move(compiler), std::move(module));
+}
+
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/IR/Module.h>
+
+#include "Compiler.hpp"
+
+namespace vfs
+{
+
+/**
+ * The letter a signature uses for a C++ type: v void, b bool, c uint8_t (byte), i int32_t
+ * (int), f float, d double and p any pointer (arrays, structs, builders and files).
+ */
+template <typename T> struct NativeType;
+
+template <> struct NativeType<void> { static const char code = 'v'; };
+template <> struct NativeType<bool> { static const char code = 'b'; };
+template <> struct NativeType<std::uint8_t> { static const char code = 'c'; };
+template <> struct NativeType<std::int32_t> { static const char code = 'i'; };
+template <> struct NativeType<float> { static const char code = 'f'; };
+template <> struct NativeType<double> { static const char code = 'd'; };
+template <typename T> struct NativeType<T *> { static const char code = 'p'; };
+
+template <typename Signature> struct NativeSignature;
+
+template <typename R, typename... A> struct NativeSignature<R(A...)>
+{
+	/**
+	 * @return the letters of the return type and of each parameter, in order.
+	 */
+	static std::string get()
+	{
+		return std::string({ NativeType<R>::code, NativeType<A>::code... });
+	}
+};
+
+/**
+ * A compiled and loaded module, whose functions can be called from C++.
+ *
+ * Function pointers taken from a program stay valid as long as the program lives. Strings
+ * cannot be passed from C++, so functions that take or return them cannot be looked up.
+ */
+class Program
+{
+private:
+	// the module belongs to the context of the compiler, so the compiler has to outlive it.
+	std::unique_ptr<Compiler> compiler;
+
+	llvm::Module * module;
+
+	std::unique_ptr<llvm::ExecutionEngine> engine;
+
+	void * getAddress(const std::string & name, const std::string & signature);
+
+public:
+	Program(std::unique_ptr<Compiler> compiler, std::unique_ptr<llvm::Module> module);
+
+	~Program();
+
+	/**
+	 * Looks up a function by its virtual name, Name or Name.version, or an exported one by its
+	 * C name. Throws if there is no such function or its signature is not the given one.
+	 *
+	 * Example usage:
+	 * <pre>
+	 * auto fibonacci = program->get<int32_t(int32_t)>("Fibonacci");
+	 * </pre>
+	 */
+	template <typename Signature> Signature * get(const std::string & name)
+	{
+		return reinterpret_cast<Signature *>(getAddress(name, NativeSignature<Signature>::get()));
+	}
+};
+
+template <typename Signature> class FunctionHandle;
+
+/**
+ * A function of a program that keeps the program alive. Calling it is calling the pointer.
+ */
+template <typename R, typename... A> class FunctionHandle<R(A...)>
+{
+private:
+	std::shared_ptr<Program> program;
+	R (* function)(A...);
+
+public:
+	FunctionHandle(std::shared_ptr<Program> program, R (* function)(A...)) :
+		program(program), function(function) {}
+
+	R operator()(A... arguments) const
+	{
+		return function(arguments...);
+	}
+
+	R (* get() const)(A...)
+	{
+		return function;
+	}
+};
+
+/**
+ * Compiles VFS sources into machine code in memory, and hands out their functions.
+ *
+ * Loading a new source compiles it aside, then swaps it in at once: calls that already got
+ * a function keep running the code they got, which is freed when the last of them is done.
+ * Loading and looking up can happen on any thread.
+ *
+ * Compiled code calls the runtime (libvfsrt) and C functions of the host process, so hosts
+ * link libvfsrt and export their symbols, e.g. with -rdynamic.
+ *
+ * Example usage:
+ * <pre>
+ * vfs::Engine engine;
+ * engine.load({ "kernels.vfs" });
+ *
+ * auto scale = engine.get<void(float *, int32_t, float)>("Scale");
+ * scale(buffer, size, 2.0f);
+ * </pre>
+ */
+class Engine
+{
+private:
+	CompilerOptions options;
+
+	// read and written with std::atomic_load and std::atomic_store.
+	std::shared_ptr<Program> current;
+
+	void install(std::unique_ptr<Compiler> compiler, std::unique_ptr<llvm::Module> module);
+
+public:
+	Engine(CompilerOptions options = CompilerOptions());
+
+	/**
+	 * Compiles the given source files and swaps them in. Throws CompileError on failure,
+	 * leaving the program loaded before in place.
+	 */
+	void load(std::vector<std::string> paths);
+
+	/**
+	 * Same as load, for a source that is already in memory.
+	 */
+	void loadSource(std::string name, std::string source);
+
+	/**
+	 * @return the program loaded last, or null if nothing was loaded.
+	 */
+	std::shared_ptr<Program> getProgram() const
+	{
+		return std::atomic_load(&current);
+	}
+
+	/**
+	 * Looks up a function of the current program, see Program::get. The handle keeps calling
+	 * the same code after another load, until it is looked up again.
+	 */
+	template <typename Signature> FunctionHandle<Signature> get(const std::string & name) const
+	{
+		auto program = getProgram();
+
+		if (!program) {
+			throw std::runtime_error("Nothing loaded to get " + name + " from");
+		}
+
+		return FunctionHandle<Signature>(program, program->get<Signature>(name));
+	}
+};
+
+}
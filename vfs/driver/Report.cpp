@@ -0,0 +1,143 @@
+#include "Report.hpp"
+
+#include <sys/resource.h>
+
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/Format.h>
+
+namespace vfs
+{
+
+Report::Report() :
+        phases("VFS compilation time report"),
+        functions("VFS function generation time report")
+{
+}
+
+llvm::Timer & Report::getTimer(std::map<std::string, std::unique_ptr<llvm::Timer>> & timers,
+        llvm::TimerGroup & group, const std::string & name)
+{
+    auto & timer = timers[name];
+
+    if (!timer) {
+        timer.reset(new llvm::Timer(name, group));
+    }
+
+    return *timer;
+}
+
+Report::Phase::Phase(Report & report, std::string name) : report(report), name(name)
+{
+    if (report.timePhases) {
+        timer = &getTimer(report.phaseTimers, report.phases, name);
+        timer->startTimer();
+    }
+}
+
+Report::Phase::~Phase()
+{
+    if (timer != nullptr) {
+        timer->stopTimer();
+        report.peakMemory[name] = getPeakMemory();
+    }
+}
+
+Report::FunctionPhase::FunctionPhase(Report & report, std::string name)
+{
+    if (report.timeFunctions) {
+        timer = &getTimer(report.functionTimers, report.functions, name);
+        timer->startTimer();
+    }
+}
+
+Report::FunctionPhase::~FunctionPhase()
+{
+    if (timer != nullptr) {
+        timer->stopTimer();
+    }
+}
+
+void Report::count(llvm::Module * module)
+{
+    if (!stats) {
+        return;
+    }
+
+    for (auto & function : *module) {
+        if (function.isDeclaration()) {
+            continue;
+        }
+
+        count("functions");
+
+        for (auto & block : function) {
+            count("basic blocks");
+            count("IR instructions", block.size());
+
+            for (auto & instruction : block) {
+                if (llvm::isa<llvm::AllocaInst>(instruction)) {
+                    count("allocas");
+                }
+            }
+        }
+    }
+
+    for (auto & global : module->globals()) {
+        count("globals");
+
+        // string literals are the private .str constants made by the generator.
+        if (global.getName().startswith(".str")) {
+            count("string literals");
+        }
+    }
+}
+
+uint64_t Report::getPeakMemory()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+    return (uint64_t) usage.ru_maxrss;
+#else
+    return (uint64_t) usage.ru_maxrss * 1024;
+#endif
+}
+
+void Report::print(llvm::raw_ostream & out)
+{
+    if (timePhases) {
+        phases.print(out);
+
+        out << "===" << std::string(73, '-') << "===\n";
+        out << "                      VFS peak memory report\n";
+        out << "===" << std::string(73, '-') << "===\n";
+        out << "  Peak RSS after phase (MB)   --- Phase ---\n";
+
+        for (auto & phase : peakMemory) {
+            out << llvm::format("  %25.1f", phase.second / (1024.0 * 1024.0)) << "   " << phase.first << "\n";
+        }
+
+        out << "\n";
+    }
+
+    if (timeFunctions) {
+        functions.print(out);
+    }
+
+    if (stats) {
+        out << "===" << std::string(73, '-') << "===\n";
+        out << "                          VFS statistics\n";
+        out << "===" << std::string(73, '-') << "===\n";
+
+        for (auto & counter : counters) {
+            out << llvm::format("%10llu", (unsigned long long) counter.second) << " " << counter.first << "\n";
+        }
+
+        out << "\n";
+    }
+
+    out.flush();
+}
+
+}
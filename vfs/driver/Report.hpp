@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Timer.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace vfs
+{
+
+/**
+ * Times the phases of a compilation and counts what it produced, for --time-report and
+ * --stats. When neither is enabled, a report does nothing.
+ */
+class Report
+{
+private:
+	llvm::TimerGroup phases;
+	llvm::TimerGroup functions;
+
+	std::map<std::string, std::unique_ptr<llvm::Timer>> phaseTimers;
+	std::map<std::string, std::unique_ptr<llvm::Timer>> functionTimers;
+
+	// peak resident memory of the process when each phase last ended, in bytes.
+	std::map<std::string, uint64_t> peakMemory;
+
+	std::map<std::string, uint64_t> counters;
+
+	static llvm::Timer & getTimer(std::map<std::string, std::unique_ptr<llvm::Timer>> & timers,
+			llvm::TimerGroup & group, const std::string & name);
+
+public:
+	bool timePhases = false;
+	bool timeFunctions = false;
+	bool stats = false;
+
+	Report();
+
+	/**
+	 * Times a phase while it is in scope. Phases with the same name add up.
+	 */
+	class Phase
+	{
+	private:
+		Report & report;
+		std::string name;
+		llvm::Timer * timer = nullptr;
+
+	public:
+		Phase(Report & report, std::string name);
+
+		Phase(const Phase &) = delete;
+		Phase & operator=(const Phase &) = delete;
+
+		~Phase();
+	};
+
+	/**
+	 * Times the generation of one function.
+	 */
+	class FunctionPhase
+	{
+	private:
+		llvm::Timer * timer = nullptr;
+
+	public:
+		FunctionPhase(Report & report, std::string name);
+
+		FunctionPhase(const FunctionPhase &) = delete;
+		FunctionPhase & operator=(const FunctionPhase &) = delete;
+
+		~FunctionPhase();
+	};
+
+	void count(const std::string & counter, uint64_t amount = 1)
+	{
+		if (stats) {
+			counters[counter] += amount;
+		}
+	}
+
+	/**
+	 * Counts the functions, instructions, allocas, globals and string literals of a module.
+	 */
+	void count(llvm::Module * module);
+
+	/**
+	 * @return the peak resident memory of the process so far, in bytes.
+	 */
+	static uint64_t getPeakMemory();
+
+	/**
+	 * Prints whatever was enabled, and resets the timers.
+	 */
+	void print(llvm::raw_ostream & out);
+};
+
+}
@@ -0,0 +1,260 @@
+#include "Lexer.hpp"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <llvm/ADT/StringSwitch.h>
+
+
+static inline bool isLower(char c)
+{
+    return c >= 'a' && c <= 'z';
+}
+
+static inline bool isUpper(char c)
+{
+    return c >= 'A' && c <= 'Z';
+}
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isAlphanumeric(char c)
+{
+    return isLower(c) || isUpper(c) || isDigit(c);
+}
+
+void Lexer::skip()
+{
+    while (current < end) {
+        char c = *current;
+
+        if (c == ' ' || c == '\t' || c == '\r') {
+            current++;
+        } else if (c == '\n') {
+            context.line++;
+            current++;
+        } else if (c == '/' && current + 1 < end && current[1] == '/') {
+            // the newline is left for the next round, so it is counted.
+            auto newline = static_cast<const char *>(std::memchr(current, '\n', end - current));
+            current = newline != nullptr ? newline : end;
+        } else {
+            return;
+        }
+    }
+}
+
+int Lexer::next(YYSTYPE * lvalue)
+{
+    skip();
+
+    if (current == end) {
+        context.token = llvm::StringRef();
+        return 0;
+    }
+
+    const char * begin = current;
+    char c = *current++;
+    int token;
+
+    if (isLower(c)) {
+        token = word(lvalue, begin);
+    } else if (isDigit(c)) {
+        token = number(lvalue, begin);
+    } else {
+        switch (c) {
+            case '@': token = name(lvalue, begin, FUNCTION_NAME); break;
+            case '#': token = name(lvalue, begin, STRUCT_NAME); break;
+            case '"': token = string(lvalue); break;
+            case '=': token = accept('=') ? EQ : ASSIGN; break;
+            case '!': token = accept('=') ? NEQ : '!'; break;
+            case '<': token = accept('=') ? LEQ : LESS; break;
+            case '>': token = accept('=') ? GEQ : GREATER; break;
+            case '&': token = accept('&') ? AND : '&'; break;
+            case '|': token = accept('|') ? OR : '|'; break;
+            case '%': token = MOD; break;
+            case '.': token = accept('.') ? DOTS : '.'; break;
+            case '+': token = lvalue->token = PLUS; break;
+            case '-': token = lvalue->token = MINUS; break;
+            case '*': token = lvalue->token = MULT; break;
+            case '/': token = lvalue->token = DIV; break;
+            case 'E':
+                if (end - current >= 2 && current[0] == 'n' && current[1] == 'd') {
+                    current += 2;
+                    token = END;
+                } else {
+                    token = c;
+                }
+                break;
+            default: token = (unsigned char) c; break;
+        }
+    }
+
+    context.token = llvm::StringRef(begin, current - begin);
+    return token;
+}
+
+int Lexer::word(YYSTYPE * lvalue, const char * begin)
+{
+    while (current < end && isAlphanumeric(*current)) {
+        current++;
+    }
+
+    llvm::StringRef text(begin, current - begin);
+
+    int token = llvm::StringSwitch<int>(text)
+            .Case("void", VOID)
+            .Case("print", PRINT)
+            .Case("var", VAR)
+            .Case("return", RETURN)
+            .Case("if", IF)
+            .Case("else", ELSE)
+            .Case("for", FOR)
+            .Case("in", IN)
+            .Case("while", WHILE)
+            .Case("do", DO)
+            .Case("break", BREAK)
+            .Case("continue", CONTINUE)
+            .Case("match", MATCH)
+            .Case("import", IMPORT)
+            .Case("extern", EXTERN)
+            .Case("export", EXPORT)
+            .Case("spawn", SPAWN)
+            .Case("await", AWAIT)
+            .Case("true", TRUE)
+            .Case("false", FALSE)
+            .Default(IDENTIFIER);
+
+    if (token == IDENTIFIER) {
+        lvalue->symbol = Symbol::get(text);
+    }
+
+    return token;
+}
+
+int Lexer::name(YYSTYPE * lvalue, const char * begin, int token)
+{
+    // a lone @ or # is a token of its own.
+    if (current == end || !isUpper(*current)) {
+        return *begin;
+    }
+
+    while (current < end && isAlphanumeric(*current)) {
+        current++;
+    }
+
+    lvalue->symbol = Symbol::get(llvm::StringRef(begin + 1, current - begin - 1));
+    return token;
+}
+
+int Lexer::number(YYSTYPE * lvalue, const char * begin)
+{
+    while (current < end && isDigit(*current)) {
+        current++;
+    }
+
+    // floats are written with a trailing f: 1.5f
+    if (current < end && *current == '.') {
+        const char * suffix = current + 1;
+
+        while (suffix < end && isDigit(*suffix)) {
+            suffix++;
+        }
+
+        if (suffix < end && *suffix == 'f') {
+            // strtof stops at the suffix, so it never reads past the view.
+            lvalue->floatNumber = std::strtof(begin, nullptr);
+            current = suffix + 1;
+            return FLOAT;
+        }
+    }
+
+    long long value = 0;
+
+    for (const char * digit = begin; digit < current; digit++) {
+        value = value * 10 + (*digit - '0');
+
+        if (value > INT_MAX) {
+            throw std::runtime_error("Integer out of range at line " + std::to_string(context.line));
+        }
+    }
+
+    lvalue->integer = (int) value;
+    return INTEGER;
+}
+
+int Lexer::string(YYSTYPE * lvalue)
+{
+    const char * begin = current;
+
+    while (current < end && *current != '"' && *current != '\\' && *current != '\n') {
+        current++;
+    }
+
+    auto value = context.arena->make<std::string>(begin, current);
+
+    // only literals with escapes are built piece by piece.
+    while (current < end && *current == '\\') {
+        current++;
+
+        switch (current < end ? *current : '\0') {
+            case 'n': value->push_back('\n'); break;
+            case 't': value->push_back('\t'); break;
+            case '\\': value->push_back('\\'); break;
+            case '"': value->push_back('"'); break;
+            default:
+                throw std::runtime_error("Unknown escape sequence at line " + std::to_string(context.line));
+        }
+
+        begin = ++current;
+
+        while (current < end && *current != '"' && *current != '\\' && *current != '\n') {
+            current++;
+        }
+
+        value->append(begin, current);
+    }
+
+    if (current == end || *current != '"') {
+        throw std::runtime_error("Unterminated string at line " + std::to_string(context.line));
+    }
+
+    current++;
+
+    lvalue->string = value;
+    return STRING;
+}
+
+int yylex(YYSTYPE * lvalue, void * scanner)
+{
+    return static_cast<Lexer *>(scanner)->next(lvalue);
+}
+
+void parse(llvm::StringRef source, ParseContext & context)
+{
+    Lexer lexer(source, context);
+    yyparse(&context, &lexer);
+}
+
+std::vector<std::string> findImports(llvm::StringRef source)
+{
+    Arena arena;
+    ParseContext context(&arena);
+    Lexer lexer(source, context);
+
+    std::vector<std::string> imports;
+    YYSTYPE value;
+
+    for (int token = lexer.next(&value); token != 0; token = lexer.next(&value)) {
+        if (token == IMPORT && lexer.next(&value) == STRING) {
+            imports.push_back(*value.string);
+        }
+    }
+
+    return imports;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+
+#include "ParseContext.hpp"
+#include "../gen/Parser.hpp"
+
+/**
+ * Splits a source into the tokens of the parser.
+ *
+ * The lexer works in place over the text it is given: every token is a view into it, and
+ * names are interned straight from the view, so nothing is copied except the value of string
+ * literals, which have to outlive the text.
+ */
+class Lexer
+{
+private:
+	ParseContext & context;
+
+	const char * current;
+	const char * end;
+
+	// skips whitespace and comments, counting lines.
+	void skip();
+
+	int word(YYSTYPE * lvalue, const char * begin);
+
+	int name(YYSTYPE * lvalue, const char * begin, int token);
+
+	int number(YYSTYPE * lvalue, const char * begin);
+
+	int string(YYSTYPE * lvalue);
+
+	bool accept(char c)
+	{
+		if (current < end && *current == c) {
+			current++;
+			return true;
+		}
+
+		return false;
+	}
+
+public:
+	Lexer(llvm::StringRef source, ParseContext & context) :
+		context(context), current(source.begin()), end(source.end()) {}
+
+	/**
+	 * Reads the next token, and sets its value if it has one.
+	 *
+	 * @return the token, or 0 at the end of the source.
+	 */
+	int next(YYSTYPE * lvalue);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+
+#include "../ast/SyntaxTree.hpp"
+#include "../context/Arena.hpp"
+
+/**
+ * Everything the parser and the lexer produce or keep while reading one source.
+ *
+ * Each parse owns its context, so several sources can be parsed at the same time.
+ */
+struct ParseContext
+{
+	// owns every node and string literal made while parsing. It can be swapped between top
+	// level definitions, so each one lives in an arena of its own.
+	Arena * arena;
+
+	std::vector<Function *> program;
+	std::vector<Struct *> structs;
+	std::vector<std::string> imports;
+
+	// when set, top level definitions are handed over as soon as they are read, instead of
+	// being collected in program and structs.
+	std::function<void(Function *)> onFunction;
+	std::function<void(Struct *)> onStruct;
+
+	size_t line = 1;
+
+	// the last token read, as a view into the source.
+	llvm::StringRef token;
+
+	ParseContext(Arena * arena) : arena(arena) {}
+
+	void add(Function * function)
+	{
+		if (onFunction) {
+			onFunction(function);
+		} else {
+			program.push_back(function);
+		}
+	}
+
+	void add(Struct * structDef)
+	{
+		if (onStruct) {
+			onStruct(structDef);
+		} else {
+			structs.push_back(structDef);
+		}
+	}
+};
+
+/**
+ * Parses a whole source into the given context. The source only has to live during the call.
+ *
+ * Throws on syntax errors.
+ */
+void parse(llvm::StringRef source, ParseContext & context);
+
+/**
+ * Finds the imports of a source by reading its tokens, without parsing it.
+ */
+std::vector<std::string> findImports(llvm::StringRef source);
@@ -6,35 +6,43 @@
 
 	#include "../type/Types.hpp"
 	#include "../ast/SyntaxTree.hpp"
+%}
 
-	size_t yyline = 1;
-
-	int yydebug = 1;
-
-	extern int yylex();
+%code requires
+{
+	#include "../parser/ParseContext.hpp"
+}
 
-	extern std::vector<std::shared_ptr<Function>> program;
-	extern std::vector<std::shared_ptr<Struct>> structs;
+%code
+{
+	extern int yylex(YYSTYPE * lvalue, void * scanner);
 
-	void yyerror(const char *str)
+	void yyerror(ParseContext * context, void * scanner, const char *str)
 	{
-        throw std::runtime_error(std::string(str) + " at line " + std::to_string(yyline));
+        throw std::runtime_error(std::string(str) + " at line " + std::to_string(context->line)
+                + " near '" + context->token.str() + "'");
 	}
-%}
+}
+
+%define api.pure full
+%parse-param { ParseContext * context } { void * scanner }
+%lex-param { void * scanner }
 
 %union
 {
-	std::vector<std::shared_ptr<Parameter>> * parameterList;
-	std::vector<std::shared_ptr<Expression>> * expressionList;
+	std::vector<Parameter *> * parameterList;
+	std::vector<Expression *> * expressionList;
 
 	Block * block;
 	Function * function;
 	Struct * structDef;
 	Statement * statement;
+	Match * match;
 	Expression * expression;
 	Type * type;
 
 	std::string * string;
+	Symbol symbol;
 	int integer;
 	int token;
 	float floatNumber;
@@ -42,27 +50,35 @@
 
 %error-verbose
 
-%token VAR ASSIGN END RETURN IF ELSE PRINT VOID FOR TRUE FALSE PRINT_F
+%token VAR ASSIGN END RETURN IF ELSE PRINT VOID FOR TRUE FALSE PRINT_F IMPORT EXTERN EXPORT SPAWN AWAIT
+%token WHILE DO BREAK CONTINUE IN DOTS AND OR MATCH
 
 %token <token> PLUS MINUS MULT DIV EQ NEQ LESS GREATER LEQ GEQ MOD
 %token <integer> INTEGER
 %token <floatNumber> FLOAT
-%token <string> FUNCTION_NAME STRUCT_NAME IDENTIFIER STRING
+%token <symbol> FUNCTION_NAME STRUCT_NAME IDENTIFIER
+%token <string> STRING
 
 %type <structDef> struct
-%type <function> function
+%type <function> function external
 %type <parameterList> parameterList structMembers
 %type <block> block
 %type <type> typeName parameterName
-%type <statement> statement assignment return variableDeclaration if print for
+%type <statement> statement assignment return variableDeclaration if print for loop match
 %type <expression> expression versionInv functionCall
-%type <expressionList> expressionList
+%type <expressionList> expressionList caseValues
+%type <match> cases
+%type <expression> caseValue
 
+%left OR
+%left AND
 %left EQ NEQ
 %left LESS GREATER
 %left LEQ GEQ
 %left PLUS MINUS
 %left MULT DIV MOD
+%right '!'
+%right AWAIT
 
 %right IDENTIFIER '['
 
@@ -74,68 +90,94 @@ program:
 	// empty
 	| program function
 	{
-		program.push_back(std::shared_ptr<Function>($2));
+		context->add($2);
+	}
+	| program external
+	{
+		context->add($2);
 	}
 	| program struct
     {
-        structs.push_back(std::shared_ptr<Struct>($2));
+        context->add($2);
     }
+	| program IMPORT STRING
+	{
+		context->imports.push_back(*$3);
+	}
 	;
 
 function:
 	FUNCTION_NAME '(' parameterList ')' block END
 	{
-		$$ = new Function(*$1, "", *$3, std::shared_ptr<Block>($5));
+		$$ = context->arena->make<Function>($1, Symbol::get(""), std::move(*$3), context->arena->make<Type>(Symbol::get("void")), $5);
 	}
 	| FUNCTION_NAME '(' parameterList ')' ':' typeName block END
 	{
-		$$ = new Function(*$1, "", *$3, std::shared_ptr<Type>($6), std::shared_ptr<Block>($7));
+		$$ = context->arena->make<Function>($1, Symbol::get(""), std::move(*$3), $6, $7);
 	}
 	| FUNCTION_NAME '(' IDENTIFIER ';' parameterList ')' block END
 	{
-		$$ = new Function(*$1, *$3, *$5, std::shared_ptr<Block>($7));
+		$$ = context->arena->make<Function>($1, $3, std::move(*$5), context->arena->make<Type>(Symbol::get("void")), $7);
 	}
 	| FUNCTION_NAME '(' IDENTIFIER ';' parameterList ')' ':' typeName block END
 	{
-		$$ = new Function(*$1, *$3, *$5, std::shared_ptr<Type>($8), std::shared_ptr<Block>($9));
+		$$ = context->arena->make<Function>($1, $3, std::move(*$5), $8, $9);
+	}
+	;
+
+external:
+	EXTERN STRING FUNCTION_NAME '(' parameterList ')'
+	{
+		$$ = context->arena->make<Function>($3, Symbol::get(""), std::move(*$5), context->arena->make<Type>(Symbol::get("void")), nullptr);
+		$$->external = Symbol::get(*$2);
+	}
+	| EXTERN STRING FUNCTION_NAME '(' parameterList ')' ':' typeName
+	{
+		$$ = context->arena->make<Function>($3, Symbol::get(""), std::move(*$5), $8, nullptr);
+		$$->external = Symbol::get(*$2);
+	}
+	| EXPORT STRING function
+	{
+		$$ = $3;
+		$$->external = Symbol::get(*$2);
 	}
 	;
 
 parameterList:
 	// empty
 	{
-		$$ = new std::vector<std::shared_ptr<Parameter>>();
+		$$ = context->arena->make<std::vector<Parameter *>>();
 	}
 	| parameterList ',' parameterName IDENTIFIER
 	{
-		$1->push_back(std::make_shared<Parameter>(*$4, std::shared_ptr<Type>($3)));
+		$1->push_back(context->arena->make<Parameter>($4, $3));
 	}
 	| parameterName IDENTIFIER
 	{
-		$$ = new std::vector<std::shared_ptr<Parameter>>();
-		$$->push_back(std::make_shared<Parameter>(*$2, std::shared_ptr<Type>($1)));
+		$$ = context->arena->make<std::vector<Parameter *>>();
+		$$->push_back(context->arena->make<Parameter>($2, $1));
 	}
 	;
 
 struct:
     STRUCT_NAME structMembers END
     {
-        $$ = new Struct(*$1, *$2);
+        $$ = context->arena->make<Struct>($1, std::move(*$2));
     }
     ;
 
 structMembers:
     // empty.
     {
-        $$ = new std::vector<std::shared_ptr<Parameter>>();
+        $$ = context->arena->make<std::vector<Parameter *>>();
     }
     | structMembers IDENTIFIER IDENTIFIER
     {
-        $1->push_back(std::make_shared<Parameter>(*$3, std::make_shared<Type>(*$2)));
+        $1->push_back(context->arena->make<Parameter>($3, context->arena->make<Type>($2)));
     }
     | structMembers STRUCT_NAME IDENTIFIER
     {
-        $1->push_back(std::make_shared<Parameter>(*$3, std::make_shared<StructType>(*$2)));
+        $1->push_back(context->arena->make<Parameter>($3, context->arena->make<StructType>($2)));
     }
     ;
 
@@ -143,30 +185,30 @@ structMembers:
 variableDeclaration:
 	VAR IDENTIFIER ':' typeName ASSIGN expression
 	{
-		$$ = new VarDecl(*$2, std::shared_ptr<Type>($4), std::shared_ptr<Expression>($6));
+		$$ = context->arena->make<VarDecl>($2, $4, $6);
 	}
 	| VAR IDENTIFIER ASSIGN expression
 	{
-		$$ = new VarDecl(*$2, std::shared_ptr<Type>(nullptr), std::shared_ptr<Expression>($4));
+		$$ = context->arena->make<VarDecl>($2, nullptr, $4);
 	}
 	| VAR IDENTIFIER ':' typeName
 	{
-		$$ = new VarDecl(*$2, std::shared_ptr<Type>($4));
+		$$ = context->arena->make<VarDecl>($2, $4);
 	}
 	;
 
 typeName:
 	IDENTIFIER
 	{
-		$$ = new Type(*$1);
+		$$ = context->arena->make<Type>($1);
 	}
 	| IDENTIFIER '[' expression ']'
 	{
-		$$ = new ArrayType(*$1, std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<ArrayType>(context->arena->make<Type>($1), $3);
 	}
 	| STRUCT_NAME
 	{
-	    $$ = new StructType(*$1);
+	    $$ = context->arena->make<StructType>($1);
 	}
 	;
 
@@ -174,18 +216,18 @@ parameterName:
 	typeName
 	| IDENTIFIER '[' ']'
 	{
-		$$ = new ArrayType(*$1);
+		$$ = context->arena->make<ArrayType>(context->arena->make<Type>($1), context->arena->make<Integer>(1));
 	}
 	;
 
 block:
 	// empty
 	{
-		$$ = new Block();
+		$$ = context->arena->make<Block>();
 	}
 	| block statement
 	{
-		$1->statements.push_back(std::shared_ptr<Statement>($2));
+		$1->statements.push_back($2);
 	}
 	;
 
@@ -193,27 +235,29 @@ statement:
 	assignment
 	| expression
 	{
-		$$ = new ExpressionStatement(std::shared_ptr<Expression>($1));
+		$$ = context->arena->make<ExpressionStatement>($1);
 	}
 	| return
 	| variableDeclaration
 	| if
 	| print
 	| for
+	| loop
+	| match
 	;
 
 assignment:
 	IDENTIFIER ASSIGN expression
 	{
-		$$ = new Assignment(*$1, std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<Assignment>($1, $3);
 	}
 	| IDENTIFIER '[' expression ']' ASSIGN expression
 	{
-		$$ = new ArrayAssignment(*$1, std::shared_ptr<Expression>($3), std::shared_ptr<Expression>($6));
+		$$ = context->arena->make<ArrayAssignment>($1, $3, $6);
 	}
 	| IDENTIFIER '.' IDENTIFIER ASSIGN expression
 	{
-		$$ = new StructAssignment(*$1, *$3, std::shared_ptr<Expression>($5));
+		$$ = context->arena->make<StructAssignment>($1, $3, $5);
 	}
 	;
 
@@ -222,71 +266,83 @@ expression:
 	| versionInv
 	| STRING
 	{
-		$$ = new String(*$1);
+		$$ = context->arena->make<String>(*$1);
 	}
 	| IDENTIFIER '[' expression ']'
 	{
-		$$ = new ArrayIndex(*$1, std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<ArrayIndex>($1, $3);
 	}
 	| IDENTIFIER '.' IDENTIFIER
 	{
-		$$ = new StructMember(*$1, *$3);
+		$$ = context->arena->make<StructMember>($1, $3);
 	}
 	| IDENTIFIER
 	{
-		$$ = new Identifier(*$1);
+		$$ = context->arena->make<Identifier>($1);
 	}
 	| INTEGER
 	{
-		$$ = new Integer($1);
+		$$ = context->arena->make<Integer>($1);
 	}
 	| FLOAT
 	{
-		$$ = new Float($1);
+		$$ = context->arena->make<Float>($1);
 	}
 	| expression PLUS expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "+", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Add, $3);
 	}
 	| expression MULT expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "*", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Mul, $3);
 	}
 	| expression DIV expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "/", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Div, $3);
 	}
 	| expression MINUS expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "-", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Sub, $3);
 	}
 	| expression EQ expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "==", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Eq, $3);
 	}
 	| expression NEQ expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "!=", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Neq, $3);
 	}
 	| expression LESS expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "<", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Less, $3);
 	}
 	| expression GREATER expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), ">", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Greater, $3);
 	}
 	| expression LEQ expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "<=", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Leq, $3);
 	}
 	| expression GEQ expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), ">=", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Geq, $3);
 	}
 	| expression MOD expression
 	{
-		$$ = new BinaryOp(std::shared_ptr<Expression>($1), "%", std::shared_ptr<Expression>($3));
+		$$ = context->arena->make<BinaryOp>($1, Operator::Mod, $3);
+	}
+	| expression AND expression
+	{
+		$$ = context->arena->make<Logical>($1, true, $3);
+	}
+	| expression OR expression
+	{
+		$$ = context->arena->make<Logical>($1, false, $3);
+	}
+	| '!' expression
+	{
+		$$ = context->arena->make<Not>($2);
 	}
 	| '(' expression ')'
 	{
@@ -294,93 +350,183 @@ expression:
 	}
 	| '[' expressionList ']'
 	{
-		$$ = new Array(*$2);
+		$$ = context->arena->make<Array>(std::move(*$2));
+	}
+	| SPAWN functionCall
+	{
+		$$ = context->arena->make<Spawn>(static_cast<FunctionCall *>($2));
+	}
+	| AWAIT expression
+	{
+		$$ = context->arena->make<Await>($2);
 	}
 	| TRUE
 	{
-	    $$ = new Bool(true);
+	    $$ = context->arena->make<Bool>(true);
 	}
 	| FALSE
 	{
-	    $$ = new Bool(false);
+	    $$ = context->arena->make<Bool>(false);
 	}
 	;
 
 functionCall:
 	FUNCTION_NAME '(' expressionList ')'
 	{
-		$$ = new FunctionCall(*$1, "", *$3);
+		$$ = context->arena->make<FunctionCall>($1, Symbol::get(""), std::move(*$3));
 	}
 	| FUNCTION_NAME '(' IDENTIFIER ';' expressionList ')'
 	{
-		$$ = new FunctionCall(*$1, *$3, *$5);
+		$$ = context->arena->make<FunctionCall>($1, $3, std::move(*$5));
 	}
 
 versionInv:
 	'@' '(' expressionList ')'
 	{
-		$$ = new VersionInv("", *$3);
+		$$ = context->arena->make<VersionInv>(Symbol::get(""), std::move(*$3));
 	}
 	| '@' '(' IDENTIFIER ';' expressionList ')'
 	{
-		$$ = new VersionInv(*$3, *$5);
+		$$ = context->arena->make<VersionInv>($3, std::move(*$5));
 	}
 	;
 
 expressionList:
 	// empty
 	{
-		$$ = new std::vector<std::shared_ptr<Expression>>();
+		$$ = context->arena->make<std::vector<Expression *>>();
 	}
 	| expressionList ',' expression
 	{
-		$1->push_back(std::shared_ptr<Expression>($3));
+		$1->push_back($3);
 	}
 	| expression
 	{
-		$$ = new std::vector<std::shared_ptr<Expression>>();
-		$$->push_back(std::shared_ptr<Expression>($1));
+		$$ = context->arena->make<std::vector<Expression *>>();
+		$$->push_back($1);
 	}
 	;
 
 return:
 	RETURN VOID
 	{
-		$$ = new Return();
+		$$ = context->arena->make<Return>();
 	}
 	| RETURN expression
 	{
-		$$ = new Return(std::shared_ptr<Expression>($2));
+		$$ = context->arena->make<Return>($2);
 	}
 	;
 
 if:
 	IF expression '{' block '}'
 	{
-		$$ = new If(std::shared_ptr<Expression>($2), std::shared_ptr<Block>($4), std::shared_ptr<Block>(nullptr));
+		$$ = context->arena->make<If>($2, $4, nullptr);
 	}
 	| IF expression '{' block '}' ELSE '{' block '}'
 	{
-		$$ = new If(std::shared_ptr<Expression>($2), std::shared_ptr<Block>($4), std::shared_ptr<Block>($8));
+		$$ = context->arena->make<If>($2, $4, $8);
 	}
 	;
 
 print:
 	PRINT expression
 	{
-		$$ = new Print(std::shared_ptr<Expression>($2));
+		$$ = context->arena->make<Print>($2);
 	}
 	;
 
 for:
 	FOR IDENTIFIER ASSIGN expression ',' expression '{' block '}'
 	{
-		$$ = new For(*$2, std::shared_ptr<Expression>($4), std::shared_ptr<Expression>($6),
-				std::shared_ptr<Block>($8));
+		$$ = context->arena->make<For>($2, $4, $6, $8, context->arena->make<Integer>(1));
 	}
 	| FOR IDENTIFIER ASSIGN expression ',' expression ',' expression '{' block '}'
 	{
-		$$ = new For(*$2, std::shared_ptr<Expression>($4), std::shared_ptr<Expression>($6),
-				std::shared_ptr<Block>($10), std::shared_ptr<Expression>($8));
+		$$ = context->arena->make<For>($2, $4, $6, $10, $8);
+	}
+	| FOR IDENTIFIER IN expression DOTS expression '{' block '}'
+	{
+		$$ = context->arena->make<Range>($2, $4, $6, context->arena->make<Integer>(1), $8);
+	}
+	| FOR IDENTIFIER IN expression DOTS expression IDENTIFIER expression '{' block '}'
+	{
+		// step is only a keyword here, so it can still name variables and versions.
+		if ($7 != Symbol::get("step")) {
+			yyerror(context, scanner, "syntax error, expected step");
+		}
+
+		$$ = context->arena->make<Range>($2, $4, $6, $8, $10);
+	}
+	;
+
+match:
+	MATCH expression '{' cases '}'
+	{
+		$4->subject = $2;
+		$$ = $4;
+	}
+	| MATCH expression '{' cases ELSE '{' block '}' '}'
+	{
+		$4->subject = $2;
+		$4->otherwise = $7;
+		$$ = $4;
+	}
+	;
+
+cases:
+	// empty
+	{
+		$$ = context->arena->make<Match>();
+	}
+	| cases caseValues '{' block '}'
+	{
+		$1->cases.push_back({ std::move(*$2), $4 });
+	}
+	;
+
+caseValues:
+	caseValue
+	{
+		$$ = context->arena->make<std::vector<Expression *>>();
+		$$->push_back($1);
+	}
+	| caseValues ',' caseValue
+	{
+		$1->push_back($3);
+	}
+	;
+
+caseValue:
+	INTEGER
+	{
+		$$ = context->arena->make<Integer>($1);
+	}
+	| MINUS INTEGER
+	{
+		$$ = context->arena->make<Integer>(-$2);
+	}
+	| STRING
+	{
+		$$ = context->arena->make<String>(*$1);
+	}
+	;
+
+loop:
+	WHILE expression '{' block '}'
+	{
+		$$ = context->arena->make<While>($2, $4, false);
+	}
+	| DO '{' block '}' WHILE expression
+	{
+		$$ = context->arena->make<While>($6, $3, true);
+	}
+	| BREAK
+	{
+		$$ = context->arena->make<Break>();
+	}
+	| CONTINUE
+	{
+		$$ = context->arena->make<Continue>();
 	}
 	;
@@ -0,0 +1,199 @@
+/*
+ * Queues and counters that tasks of VFS programs share, without a lock.
+ *
+ * A queue is the bounded multi producer, multi consumer queue of Dmitry Vyukov: a ring of
+ * cells, each with a sequence number that tells producers and consumers whose turn it is,
+ * so the only contended writes are the two positions, each on a cache line of its own.
+ * Pushing to a full queue, or popping from an empty one, yields the thread until it can.
+ *
+ * A counter is split in cells on lines of their own, and every thread adds to its cell, so
+ * adding never bounces a line between cores the way one atomic would. Reading the sum adds
+ * the cells up, so it is only exact once nothing adds anymore.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LINE 64
+
+typedef struct
+{
+    atomic_size_t sequence;
+    int32_t value;
+} cell;
+
+typedef struct vfs_queue
+{
+    _Alignas(LINE) atomic_size_t head;
+    _Alignas(LINE) atomic_size_t tail;
+    _Alignas(LINE) size_t mask;
+    cell * cells;
+} vfs_queue;
+
+typedef struct
+{
+    _Alignas(LINE) atomic_int_fast64_t value;
+} stripe;
+
+#define STRIPES 64
+
+typedef struct vfs_counter
+{
+    stripe stripes[STRIPES];
+} vfs_counter;
+
+/* the stripe of the calling thread, handed out in turn. */
+static atomic_uint nextStripe = 0;
+static __thread int ownStripe = -1;
+
+static void * allocate(size_t size)
+{
+    /* aligned_alloc takes sizes that are a multiple of the alignment. */
+    void * memory = aligned_alloc(LINE, (size + LINE - 1) & ~(size_t) (LINE - 1));
+
+    if (memory == NULL) {
+        fputs("vfs: out of memory\n", stderr);
+        abort();
+    }
+
+    return memory;
+}
+
+vfs_queue * vfs_queue_new(int32_t capacity)
+{
+    size_t size = 2;
+
+    while (size < (size_t) capacity) {
+        size *= 2;
+    }
+
+    vfs_queue * queue = allocate(sizeof(vfs_queue));
+    queue->cells = allocate(size * sizeof(cell));
+    queue->mask = size - 1;
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+
+    return queue;
+}
+
+bool vfs_queue_offer(vfs_queue * queue, int32_t value)
+{
+    size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    for (;;) {
+        cell * c = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&c->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                c->value = value;
+                atomic_store_explicit(&c->sequence, position + 1, memory_order_release);
+
+                return true;
+            }
+        } else if (difference < 0) {
+            /* the cell still holds what was pushed a lap ago. */
+            return false;
+        } else {
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+}
+
+/* takes a value into *value, or returns false if the queue is empty. */
+static bool take(vfs_queue * queue, int32_t * value)
+{
+    size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    for (;;) {
+        cell * c = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&c->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) (position + 1);
+
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                *value = c->value;
+                atomic_store_explicit(&c->sequence, position + queue->mask + 1, memory_order_release);
+
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+}
+
+void vfs_queue_push(vfs_queue * queue, int32_t value)
+{
+    while (!vfs_queue_offer(queue, value)) {
+        sched_yield();
+    }
+}
+
+int32_t vfs_queue_pop(vfs_queue * queue)
+{
+    int32_t value;
+
+    while (!take(queue, &value)) {
+        sched_yield();
+    }
+
+    return value;
+}
+
+int32_t vfs_queue_poll(vfs_queue * queue, int32_t otherwise)
+{
+    int32_t value;
+
+    return take(queue, &value) ? value : otherwise;
+}
+
+vfs_counter * vfs_counter_new(void)
+{
+    vfs_counter * counter = allocate(sizeof(vfs_counter));
+
+    for (int i = 0; i < STRIPES; i++) {
+        atomic_init(&counter->stripes[i].value, 0);
+    }
+
+    return counter;
+}
+
+void vfs_counter_add(vfs_counter * counter, int32_t amount)
+{
+    if (ownStripe < 0) {
+        ownStripe = (int) (atomic_fetch_add_explicit(&nextStripe, 1, memory_order_relaxed) % STRIPES);
+    }
+
+    /* other threads may share the stripe, so it still has to be an atomic add. */
+    atomic_fetch_add_explicit(&counter->stripes[ownStripe].value, amount, memory_order_relaxed);
+}
+
+int32_t vfs_counter_sum(vfs_counter * counter)
+{
+    int64_t sum = 0;
+
+    for (int i = 0; i < STRIPES; i++) {
+        sum += atomic_load_explicit(&counter->stripes[i].value, memory_order_relaxed);
+    }
+
+    /* wraps around like the ints of the program. */
+    return (int32_t) (uint32_t) sum;
+}
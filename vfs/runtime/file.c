@@ -0,0 +1,300 @@
+/*
+ * Files of VFS programs: mapped views for reading and buffered writers.
+ *
+ * A mapped file is a byte array over the pages of the file, so scanning it copies nothing.
+ * The mapping is private, so writes to the array stay in the program. Mappings live until
+ * the program exits; their sizes are kept in a list, so @File(size; data) can find them by
+ * the pointer that the program holds.
+ *
+ * A writer gathers what is written in a buffer, and writes it to its file when it is full,
+ * flushed or closed. Writers still open when the program exits are flushed then.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* see vfs/runtime/string.c. */
+typedef struct vfs_string vfs_string;
+
+const char * vfs_string_cstr(const vfs_string * string);
+
+struct mapping
+{
+    const uint8_t * data;
+    size_t size;
+    struct mapping * next;
+};
+
+#define WRITER_BUFFER 65536
+
+typedef struct vfs_file
+{
+    int fd;
+    size_t length;
+    struct vfs_file * next;
+    char buffer[WRITER_BUFFER];
+} vfs_file;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct mapping * mappings = NULL;
+static vfs_file * writers = NULL;
+static int flushAtExit = 0;
+
+/* the writer of stdout, made the first time it is asked for. */
+static vfs_file * out = NULL;
+
+static void fail(const char * what, const char * path)
+{
+    fprintf(stderr, "vfs: cannot %s %s: %s\n", what, path, strerror(errno));
+    exit(1);
+}
+
+static void * allocate(size_t size)
+{
+    void * memory = calloc(1, size);
+
+    if (memory == NULL) {
+        fputs("vfs: out of memory\n", stderr);
+        abort();
+    }
+
+    return memory;
+}
+
+const uint8_t * vfs_file_map(const vfs_string * path)
+{
+    const char * name = vfs_string_cstr(path);
+    int fd = open(name, O_RDONLY);
+
+    if (fd < 0) {
+        fail("open", name);
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0) {
+        fail("stat", name);
+    }
+
+    struct mapping * m = allocate(sizeof(struct mapping));
+    m->size = (size_t) info.st_size;
+
+    if (m->size == 0) {
+        /* nothing can be mapped, but the array still needs an address of its own. */
+        m->data = allocate(1);
+    } else {
+        void * data = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED) {
+            fail("map", name);
+        }
+
+        /* programs scan their input from the start, so the kernel can read ahead. */
+        posix_madvise(data, m->size, POSIX_MADV_SEQUENTIAL);
+        m->data = data;
+    }
+
+    close(fd);
+
+    pthread_mutex_lock(&lock);
+    m->next = mappings;
+    mappings = m;
+    pthread_mutex_unlock(&lock);
+
+    return m->data;
+}
+
+int32_t vfs_file_size(const uint8_t * data)
+{
+    pthread_mutex_lock(&lock);
+
+    struct mapping * m = mappings;
+
+    while (m != NULL && m->data != data) {
+        m = m->next;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    if (m == NULL) {
+        fputs("vfs: size of an array that is not a mapped file\n", stderr);
+        exit(1);
+    }
+
+    /* arrays are indexed with ints. */
+    if (m->size > INT32_MAX) {
+        fprintf(stderr, "vfs: mapped file of %zu bytes is too large to index\n", m->size);
+        exit(1);
+    }
+
+    return (int32_t) m->size;
+}
+
+static void writeAll(int fd, const char * data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            fail("write", "file");
+        }
+
+        data += written;
+        length -= (size_t) written;
+    }
+}
+
+void vfs_file_flush(vfs_file * file)
+{
+    writeAll(file->fd, file->buffer, file->length);
+    file->length = 0;
+}
+
+static void flushAll(void)
+{
+    pthread_mutex_lock(&lock);
+
+    for (vfs_file * file = writers; file != NULL; file = file->next) {
+        vfs_file_flush(file);
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+/* the lock has to be held. */
+static vfs_file * openWriter(int fd)
+{
+    vfs_file * file = allocate(sizeof(vfs_file));
+    file->fd = fd;
+
+    if (!flushAtExit) {
+        flushAtExit = 1;
+        atexit(flushAll);
+    }
+
+    file->next = writers;
+    writers = file;
+
+    return file;
+}
+
+vfs_file * vfs_file_create(const vfs_string * path)
+{
+    const char * name = vfs_string_cstr(path);
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        fail("create", name);
+    }
+
+    pthread_mutex_lock(&lock);
+    vfs_file * file = openWriter(fd);
+    pthread_mutex_unlock(&lock);
+
+    return file;
+}
+
+vfs_file * vfs_file_stdout(void)
+{
+    pthread_mutex_lock(&lock);
+
+    if (out == NULL) {
+        /* print goes through stdio, so what it buffered comes first. */
+        fflush(stdout);
+        out = openWriter(STDOUT_FILENO);
+    }
+
+    vfs_file * file = out;
+    pthread_mutex_unlock(&lock);
+
+    return file;
+}
+
+void vfs_file_close(vfs_file * file)
+{
+    vfs_file_flush(file);
+
+    pthread_mutex_lock(&lock);
+
+    /* the writer of stdout is shared by every @File(stdout;), so closing it only flushes. */
+    if (file == out) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    vfs_file ** link = &writers;
+
+    while (*link != NULL && *link != file) {
+        link = &(*link)->next;
+    }
+
+    if (*link != NULL) {
+        *link = file->next;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    close(file->fd);
+    free(file);
+}
+
+static void put(vfs_file * file, const char * data, size_t length)
+{
+    if (file->length + length > WRITER_BUFFER) {
+        vfs_file_flush(file);
+
+        /* what does not fit in an empty buffer is written as it is. */
+        if (length > WRITER_BUFFER) {
+            writeAll(file->fd, data, length);
+            return;
+        }
+    }
+
+    memcpy(file->buffer + file->length, data, length);
+    file->length += length;
+}
+
+void vfs_file_write(vfs_file * file, const vfs_string * string)
+{
+    /* the length is the first field of a string. */
+    put(file, vfs_string_cstr(string), (size_t) *(const int64_t *) string);
+}
+
+void vfs_file_write_bytes(vfs_file * file, const uint8_t * data, int32_t start, int32_t count)
+{
+    put(file, (const char *) data + start, count > 0 ? (size_t) count : 0);
+}
+
+void vfs_file_write_int(vfs_file * file, int64_t value)
+{
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%" PRId64, value);
+
+    put(file, digits, (size_t) length);
+}
+
+void vfs_file_write_double(vfs_file * file, double value)
+{
+    char digits[32];
+    int length = snprintf(digits, sizeof(digits), "%g", value);
+
+    put(file, digits, (size_t) length);
+}
@@ -0,0 +1,53 @@
+/*
+ * Arrays and structs of VFS programs that outlive the function that made them.
+ *
+ * The compiler keeps everything it can on the stack, so what comes here is still reachable
+ * after its function returns, and nothing tracks when it stops being. It is never freed, so
+ * each thread hands it out of chunks of its own by moving a pointer, which takes no lock.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHUNK (1 << 20)
+
+/* objects larger than this get an allocation of their own, so chunks are not wasted. */
+#define LARGE (CHUNK / 16)
+
+#define ALIGNMENT 16
+
+static __thread char * next = NULL;
+static __thread char * limit = NULL;
+
+static void * allocate(size_t size)
+{
+    void * memory = malloc(size);
+
+    if (memory == NULL) {
+        fputs("vfs: out of memory\n", stderr);
+        abort();
+    }
+
+    return memory;
+}
+
+void * vfs_alloc(int64_t size)
+{
+    size_t bytes = ((size_t) (size > 0 ? size : 1) + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1);
+
+    if (bytes > LARGE) {
+        return allocate(bytes);
+    }
+
+    if (next == NULL || (size_t) (limit - next) < bytes) {
+        next = allocate(CHUNK);
+        limit = next + CHUNK;
+    }
+
+    void * memory = next;
+    next += bytes;
+
+    return memory;
+}
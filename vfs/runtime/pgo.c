@@ -0,0 +1,126 @@
+/*
+ * Counters of programs compiled with -fprofile-generate.
+ *
+ * Every generated function has a record with its counters: how many times it was entered,
+ * and, for each of its conditional branches, how many times the branch was evaluated and
+ * how many times it was taken. The records of a module are registered by a constructor,
+ * and written when the program exits, as lines of
+ *
+ *     <function> <hash> <number of counters> <counters...>
+ *
+ * The hash describes the branches of the function, so the compiler ignores counters of a
+ * function that changed since. Counts already in the file are added to, so several runs
+ * make up one profile.
+ *
+ * Counters are not atomic: threads that run the same function at once may lose counts.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* layout shared with the compiler: { i8*, i64, i64, i64*, record* }. */
+struct vfs_pgo_record
+{
+    const char * name;
+    uint64_t hash;
+    uint64_t size;
+    uint64_t * counters;
+    struct vfs_pgo_record * next;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct vfs_pgo_record * records = NULL;
+static const char * path = NULL;
+
+/* adds the counters of an older run, if they were made by the same code. */
+static void merge(const char * name, uint64_t hash, uint64_t size, const uint64_t * counters)
+{
+    for (struct vfs_pgo_record * r = records; r != NULL; r = r->next) {
+        if (strcmp(r->name, name) == 0 && r->hash == hash && r->size == size) {
+            for (uint64_t i = 0; i < size; i++) {
+                r->counters[i] += counters[i];
+            }
+
+            return;
+        }
+    }
+}
+
+static void readProfile(FILE * in)
+{
+    char name[4096];
+    uint64_t hash;
+    uint64_t size;
+
+    while (fscanf(in, "%4095s %" SCNu64 " %" SCNu64, name, &hash, &size) == 3) {
+        uint64_t * counters = calloc(size > 0 ? size : 1, sizeof(uint64_t));
+
+        if (counters == NULL) {
+            return;
+        }
+
+        for (uint64_t i = 0; i < size; i++) {
+            if (fscanf(in, "%" SCNu64, &counters[i]) != 1) {
+                free(counters);
+                return;
+            }
+        }
+
+        merge(name, hash, size, counters);
+        free(counters);
+    }
+}
+
+static void writeProfile(void)
+{
+    pthread_mutex_lock(&lock);
+
+    FILE * in = fopen(path, "r");
+
+    if (in != NULL) {
+        readProfile(in);
+        fclose(in);
+    }
+
+    FILE * out = fopen(path, "w");
+
+    if (out == NULL) {
+        fprintf(stderr, "vfs: cannot write profile %s\n", path);
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    for (struct vfs_pgo_record * r = records; r != NULL; r = r->next) {
+        fprintf(out, "%s %" PRIu64 " %" PRIu64, r->name, r->hash, r->size);
+
+        for (uint64_t i = 0; i < r->size; i++) {
+            fprintf(out, " %" PRIu64, r->counters[i]);
+        }
+
+        fputc('\n', out);
+    }
+
+    fclose(out);
+
+    pthread_mutex_unlock(&lock);
+}
+
+void vfs_pgo_register(struct vfs_pgo_record * record, const char * file)
+{
+    pthread_mutex_lock(&lock);
+
+    if (path == NULL) {
+        path = file;
+        atexit(writeProfile);
+    }
+
+    record->next = records;
+    records = record;
+
+    pthread_mutex_unlock(&lock);
+}
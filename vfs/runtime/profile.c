@@ -0,0 +1,384 @@
+/*
+ * Profiler of programs compiled with --instrument.
+ *
+ * Every instrumented function has a record, made by the compiler, that it passes to
+ * vfs_profile_enter on entry and to vfs_profile_exit before each return, along with the
+ * number of loop iterations it ran. Records are numbered the first time they are entered.
+ *
+ * Each thread keeps its own counters and call stack, so the hooks take no locks. The
+ * counters of every thread are merged and written when the program exits, to the file
+ * named by VFS_PROFILE, or to stderr.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* layout shared with the compiler: { i8*, i64 }. */
+struct vfs_profile_record
+{
+    const char * name;
+    int64_t id;
+};
+
+typedef struct
+{
+    uint64_t calls;
+    uint64_t selfCycles;
+    uint64_t totalCycles;
+    uint64_t loops;
+} counters;
+
+typedef struct
+{
+    /* the caller is -1 for calls from outside instrumented code. */
+    int32_t caller;
+    int32_t callee;
+    uint64_t calls;
+    uint64_t cycles;
+} edge;
+
+typedef struct
+{
+    int32_t id;
+    uint64_t start;
+    uint64_t children;
+} frame;
+
+typedef struct thread_profile
+{
+    counters * functions;
+    size_t functionCapacity;
+
+    /* open addressing table, keyed by caller and callee. */
+    edge * edges;
+    size_t edgeCapacity;
+    size_t edgeCount;
+
+    frame * stack;
+    size_t depth;
+    size_t stackCapacity;
+
+    struct thread_profile * next;
+} thread_profile;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct vfs_profile_record ** records = NULL;
+static size_t recordCount = 0;
+static size_t recordCapacity = 0;
+
+/* every thread that ever entered an instrumented function. */
+static thread_profile * threads = NULL;
+
+static __thread thread_profile * current = NULL;
+
+static inline uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}
+
+static void * grow(void * array, size_t * capacity, size_t needed, size_t size)
+{
+    size_t old = *capacity;
+    size_t next = old == 0 ? 16 : old;
+
+    while (next < needed) {
+        next *= 2;
+    }
+
+    array = realloc(array, next * size);
+
+    if (array == NULL) {
+        fputs("vfs profile: out of memory\n", stderr);
+        abort();
+    }
+
+    memset((char *) array + old * size, 0, (next - old) * size);
+    *capacity = next;
+
+    return array;
+}
+
+static void addEdge(thread_profile * profile, int32_t caller, int32_t callee,
+        uint64_t calls, uint64_t cycles)
+{
+    if ((profile->edgeCount + 1) * 2 > profile->edgeCapacity) {
+        edge * old = profile->edges;
+        size_t oldCapacity = profile->edgeCapacity;
+
+        profile->edgeCapacity = oldCapacity == 0 ? 64 : oldCapacity * 2;
+        profile->edges = calloc(profile->edgeCapacity, sizeof(edge));
+        profile->edgeCount = 0;
+
+        if (profile->edges == NULL) {
+            fputs("vfs profile: out of memory\n", stderr);
+            abort();
+        }
+
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (old[i].calls != 0) {
+                addEdge(profile, old[i].caller, old[i].callee, old[i].calls, old[i].cycles);
+            }
+        }
+
+        free(old);
+    }
+
+    size_t mask = profile->edgeCapacity - 1;
+    size_t slot = ((uint32_t) caller * 2654435761u ^ (uint32_t) callee) & mask;
+
+    while (profile->edges[slot].calls != 0) {
+        edge * e = &profile->edges[slot];
+
+        if (e->caller == caller && e->callee == callee) {
+            e->calls += calls;
+            e->cycles += cycles;
+            return;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    profile->edges[slot].caller = caller;
+    profile->edges[slot].callee = callee;
+    profile->edges[slot].calls = calls;
+    profile->edges[slot].cycles = cycles;
+    profile->edgeCount++;
+}
+
+/* the counters of every thread, while they are dumped. */
+static counters * merged = NULL;
+
+static int compareSelf(const void * l, const void * r)
+{
+    uint64_t a = merged[*(const size_t *) l].selfCycles;
+    uint64_t b = merged[*(const size_t *) r].selfCycles;
+
+    return a < b ? 1 : (a > b ? -1 : 0);
+}
+
+static const char * nameOf(int32_t id)
+{
+    return id < 0 ? "<outside>" : records[id]->name;
+}
+
+static void dump(void)
+{
+    pthread_mutex_lock(&lock);
+
+    const char * path = getenv("VFS_PROFILE");
+    FILE * out = path != NULL ? fopen(path, "w") : stderr;
+
+    if (out == NULL) {
+        out = stderr;
+    }
+
+    /* merge the counters of every thread. */
+    thread_profile total;
+    memset(&total, 0, sizeof(total));
+
+    merged = calloc(recordCount > 0 ? recordCount : 1, sizeof(counters));
+    uint64_t allSelf = 0;
+
+    for (thread_profile * t = threads; t != NULL; t = t->next) {
+        for (size_t i = 0; i < t->functionCapacity && i < recordCount; i++) {
+            merged[i].calls += t->functions[i].calls;
+            merged[i].selfCycles += t->functions[i].selfCycles;
+            merged[i].totalCycles += t->functions[i].totalCycles;
+            merged[i].loops += t->functions[i].loops;
+            allSelf += t->functions[i].selfCycles;
+        }
+
+        for (size_t i = 0; i < t->edgeCapacity; i++) {
+            if (t->edges[i].calls != 0) {
+                addEdge(&total, t->edges[i].caller, t->edges[i].callee, t->edges[i].calls, t->edges[i].cycles);
+            }
+        }
+    }
+
+    size_t * order = malloc((recordCount > 0 ? recordCount : 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < recordCount; i++) {
+        order[i] = i;
+    }
+
+    qsort(order, recordCount, sizeof(size_t), compareSelf);
+
+    fprintf(out, "VFS flat profile\n\n");
+    fprintf(out, "%7s %16s %16s %12s %14s  %s\n", "% self", "self cycles", "total cycles", "calls", "loop iters", "name");
+
+    for (size_t i = 0; i < recordCount; i++) {
+        counters * c = &merged[order[i]];
+
+        if (c->calls == 0) {
+            continue;
+        }
+
+        fprintf(out, "%6.2f%% %16llu %16llu %12llu %14llu  %s\n",
+                allSelf > 0 ? 100.0 * c->selfCycles / allSelf : 0.0,
+                (unsigned long long) c->selfCycles, (unsigned long long) c->totalCycles,
+                (unsigned long long) c->calls, (unsigned long long) c->loops,
+                records[order[i]]->name);
+    }
+
+    fprintf(out, "\nVFS call graph\n");
+
+    for (size_t i = 0; i < recordCount; i++) {
+        int32_t id = (int32_t) order[i];
+
+        if (merged[id].calls == 0) {
+            continue;
+        }
+
+        fprintf(out, "\n%s\n", records[id]->name);
+
+        for (size_t e = 0; e < total.edgeCapacity; e++) {
+            edge * edge = &total.edges[e];
+
+            if (edge->calls != 0 && edge->callee == id) {
+                fprintf(out, "    called by %-32s %12llu calls %16llu cycles\n", nameOf(edge->caller),
+                        (unsigned long long) edge->calls, (unsigned long long) edge->cycles);
+            }
+        }
+
+        for (size_t e = 0; e < total.edgeCapacity; e++) {
+            edge * edge = &total.edges[e];
+
+            if (edge->calls != 0 && edge->caller == id) {
+                fprintf(out, "    calls     %-32s %12llu calls %16llu cycles\n", nameOf(edge->callee),
+                        (unsigned long long) edge->calls, (unsigned long long) edge->cycles);
+            }
+        }
+    }
+
+    if (out != stderr) {
+        fclose(out);
+    }
+
+    free(order);
+    free(total.edges);
+    free(merged);
+    merged = NULL;
+
+    pthread_mutex_unlock(&lock);
+}
+
+static int64_t registerRecord(struct vfs_profile_record * record)
+{
+    pthread_mutex_lock(&lock);
+
+    int64_t id = record->id;
+
+    if (id < 0) {
+        if (recordCount == 0) {
+            atexit(dump);
+        }
+
+        if (recordCount == recordCapacity) {
+            records = grow(records, &recordCapacity, recordCount + 1, sizeof(*records));
+        }
+
+        id = (int64_t) recordCount;
+        records[recordCount++] = record;
+
+        __atomic_store_n(&record->id, id, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return id;
+}
+
+static thread_profile * getThread(void)
+{
+    if (current == NULL) {
+        current = calloc(1, sizeof(thread_profile));
+
+        if (current == NULL) {
+            fputs("vfs profile: out of memory\n", stderr);
+            abort();
+        }
+
+        pthread_mutex_lock(&lock);
+        current->next = threads;
+        threads = current;
+        pthread_mutex_unlock(&lock);
+    }
+
+    return current;
+}
+
+void vfs_profile_enter(struct vfs_profile_record * record)
+{
+    int64_t id = __atomic_load_n(&record->id, __ATOMIC_ACQUIRE);
+
+    if (id < 0) {
+        id = registerRecord(record);
+    }
+
+    thread_profile * profile = getThread();
+
+    if (profile->depth == profile->stackCapacity) {
+        profile->stack = grow(profile->stack, &profile->stackCapacity, profile->depth + 1, sizeof(frame));
+    }
+
+    frame * f = &profile->stack[profile->depth++];
+    f->id = (int32_t) id;
+    f->children = 0;
+    f->start = cycles();
+}
+
+void vfs_profile_exit(struct vfs_profile_record * record, int64_t loops)
+{
+    uint64_t now = cycles();
+    thread_profile * profile = current;
+
+    (void) record;
+
+    if (profile == NULL || profile->depth == 0) {
+        return;
+    }
+
+    frame * f = &profile->stack[--profile->depth];
+    uint64_t elapsed = now - f->start;
+
+    if ((size_t) f->id >= profile->functionCapacity) {
+        profile->functions = grow(profile->functions, &profile->functionCapacity,
+                (size_t) f->id + 1, sizeof(counters));
+    }
+
+    /* recursive calls add their time to the total of every level. */
+    counters * c = &profile->functions[f->id];
+    c->calls++;
+    c->totalCycles += elapsed;
+    c->selfCycles += elapsed - f->children;
+    c->loops += (uint64_t) loops;
+
+    int32_t caller = -1;
+
+    if (profile->depth > 0) {
+        frame * parent = &profile->stack[profile->depth - 1];
+        parent->children += elapsed;
+        caller = parent->id;
+    }
+
+    addEdge(profile, caller, f->id, 1, elapsed);
+}
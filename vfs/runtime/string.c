@@ -0,0 +1,203 @@
+/*
+ * Strings and string builders of VFS programs.
+ *
+ * A string is a 24 byte value: its length, followed by its characters when there are fewer
+ * than 16 of them, or by a pointer to them otherwise. Either way the characters end with a
+ * NUL, so they can be handed to C. Strings never change once made, so copies share the
+ * characters of long strings, which are never freed since nothing tracks who uses them.
+ *
+ * A builder appends into a buffer that doubles when it is full. Finishing it hands the
+ * buffer to the string it makes, so the characters are not copied again.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* layout shared with the compiler: { i64, i8*, i64 }. */
+typedef struct
+{
+    int64_t length;
+
+    union
+    {
+        struct
+        {
+            char * data;
+            int64_t capacity;
+        } heap;
+
+        char small[16];
+    } chars;
+} vfs_string;
+
+/* layout shared with the compiler: { i8*, i64, i64 }. */
+typedef struct
+{
+    char * data;
+    int64_t length;
+    int64_t capacity;
+} vfs_builder;
+
+#define SMALL_STRING 16
+
+static void * allocate(void * memory, size_t size)
+{
+    memory = realloc(memory, size);
+
+    if (memory == NULL) {
+        fputs("vfs: out of memory\n", stderr);
+        abort();
+    }
+
+    return memory;
+}
+
+const char * vfs_string_cstr(const vfs_string * string)
+{
+    return string->length < SMALL_STRING ? string->chars.small : string->chars.heap.data;
+}
+
+/* makes room for the characters of a string of the given length, NUL included. */
+static char * reserve(vfs_string * string, int64_t length)
+{
+    string->length = length;
+
+    if (length < SMALL_STRING) {
+        return string->chars.small;
+    }
+
+    string->chars.heap.data = allocate(NULL, (size_t) length + 1);
+    string->chars.heap.capacity = length + 1;
+
+    return string->chars.heap.data;
+}
+
+void vfs_string_concat(vfs_string * result, const vfs_string * parts, int64_t count)
+{
+    int64_t length = 0;
+
+    for (int64_t i = 0; i < count; i++) {
+        length += parts[i].length;
+    }
+
+    /* the parts may alias the result, so they are copied into a new value. */
+    vfs_string out;
+    char * chars = reserve(&out, length);
+
+    for (int64_t i = 0; i < count; i++) {
+        memcpy(chars, vfs_string_cstr(&parts[i]), (size_t) parts[i].length);
+        chars += parts[i].length;
+    }
+
+    *chars = '\0';
+    *result = out;
+}
+
+/* FNV-1a of the characters, which the compiler also computes for the strings a match takes. */
+int64_t vfs_string_hash(const vfs_string * string)
+{
+    const unsigned char * chars = (const unsigned char *) vfs_string_cstr(string);
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (int64_t i = 0; i < string->length; i++) {
+        hash = (hash ^ chars[i]) * 1099511628211ULL;
+    }
+
+    return (int64_t) hash;
+}
+
+bool vfs_string_equals(const vfs_string * string, const char * chars, int64_t length)
+{
+    return string->length == length && memcmp(vfs_string_cstr(string), chars, (size_t) length) == 0;
+}
+
+static char * grow(vfs_builder * builder, int64_t length)
+{
+    int64_t needed = builder->length + length + 1;
+
+    if (needed > builder->capacity) {
+        int64_t capacity = builder->capacity < 32 ? 32 : builder->capacity * 2;
+
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+
+        builder->data = allocate(builder->data, (size_t) capacity);
+        builder->capacity = capacity;
+    }
+
+    return builder->data + builder->length;
+}
+
+static void append(vfs_builder * builder, const char * chars, int64_t length)
+{
+    memcpy(grow(builder, length), chars, (size_t) length);
+    builder->length += length;
+    builder->data[builder->length] = '\0';
+}
+
+void vfs_builder_append(vfs_builder * builder, const vfs_string * string)
+{
+    append(builder, vfs_string_cstr(string), string->length);
+}
+
+void vfs_builder_append_int(vfs_builder * builder, int64_t value)
+{
+    char digits[24];
+    char * end = digits + sizeof(digits);
+    char * begin = end;
+
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t) value : (uint64_t) value;
+
+    do {
+        *--begin = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        *--begin = '-';
+    }
+
+    append(builder, begin, end - begin);
+}
+
+void vfs_builder_append_double(vfs_builder * builder, double value)
+{
+    char digits[32];
+    int length = snprintf(digits, sizeof(digits), "%g", value);
+
+    append(builder, digits, length);
+}
+
+/* frees the buffer of a builder that is declared again, as a declaration in a loop is. */
+void vfs_builder_free(vfs_builder * builder)
+{
+    free(builder->data);
+}
+
+void vfs_builder_finish(vfs_builder * builder, vfs_string * result)
+{
+    if (builder->length < SMALL_STRING) {
+        /* the buffer stays with the builder, to be used again. */
+        result->length = builder->length;
+
+        if (builder->length > 0) {
+            memcpy(result->chars.small, builder->data, (size_t) builder->length);
+        }
+
+        result->chars.small[builder->length] = '\0';
+    } else {
+        result->length = builder->length;
+        result->chars.heap.data = builder->data;
+        result->chars.heap.capacity = builder->capacity;
+
+        builder->data = NULL;
+        builder->capacity = 0;
+    }
+
+    builder->length = 0;
+}
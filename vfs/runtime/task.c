@@ -0,0 +1,431 @@
+/*
+ * Tasks of VFS programs: spawn runs a call on a pool of threads, await waits for its result.
+ *
+ * A task is a frame, laid out by the compiler, with the result of the call followed by its
+ * arguments, behind a small header. Spawning pushes the task on the deque of the thread that
+ * spawns it. Threads run the newest tasks of their own deque, and when it is empty steal the
+ * oldest of other deques, so the big halves of a divide and conquer are what moves between
+ * threads. A thread that awaits a task keeps running other tasks until it is done, so it
+ * never blocks a core. Threads that are not in the pool, like the main one, get a deque of
+ * their own the first time they spawn.
+ *
+ * A frame is freed by the await that takes its result. Tasks nobody will await are detached
+ * instead, and freed by whichever of the task and the detach is last.
+ *
+ * The pool starts with the first spawn, with a thread per core but one, or VFS_THREADS.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* what became of a task. */
+enum
+{
+    RUNNING,
+    DONE,
+    DETACHED
+};
+
+typedef struct vfs_task
+{
+    void (* run)(void * frame);
+    atomic_int state;
+    struct vfs_task * next;
+} vfs_task;
+
+/* frames start at a 16 byte boundary after the header. */
+#define HEADER ((sizeof(vfs_task) + 15) & ~(size_t) 15)
+
+#define FRAME(task) ((void *) ((char *) (task) + HEADER))
+#define TASK(frame) ((vfs_task *) ((char *) (frame) - HEADER))
+
+/* a ring of tasks, replaced by one twice as large when full. */
+typedef struct
+{
+    int64_t size;
+    _Atomic(vfs_task *) tasks[];
+} ring;
+
+/*
+ * The work stealing deque of Chase and Lev, as written for C11 atomics by Le, Pop, Cohen
+ * and Zappa Nardelli. Only its owner pushes and takes at the bottom, anyone steals at the top.
+ */
+typedef struct
+{
+    atomic_int_fast64_t top;
+    atomic_int_fast64_t bottom;
+    _Atomic(ring *) ring;
+} deque;
+
+typedef struct
+{
+    deque tasks;
+    unsigned seed;
+} worker;
+
+/* the pool, followed by the threads outside of it that spawned tasks. */
+#define MAX_WORKERS 256
+
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+
+static _Atomic(worker *) workers[MAX_WORKERS];
+static atomic_int workerCount = 0;
+
+static __thread worker * self = NULL;
+
+/* how many tasks this thread runs inside of awaits, one in another. */
+static __thread int depth = 0;
+
+/* deep enough, awaits only run the newest task of their own thread, which is most likely
+   the one awaited, so helping does not grow the stack without end. */
+#define MAX_DEPTH 128
+
+/* tasks spawned outside of the pool once there is no room for more deques. */
+static pthread_mutex_t sharedLock = PTHREAD_MUTEX_INITIALIZER;
+static vfs_task * sharedFirst = NULL;
+static vfs_task * sharedLast = NULL;
+
+/* tasks spawned but not taken yet, and threads waiting for one. */
+static atomic_int_fast64_t pending = 0;
+static atomic_int sleepers = 0;
+static pthread_mutex_t sleepLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeUp = PTHREAD_COND_INITIALIZER;
+
+static void * allocate(size_t size)
+{
+    void * memory = malloc(size);
+
+    if (memory == NULL) {
+        fputs("vfs: out of memory\n", stderr);
+        abort();
+    }
+
+    return memory;
+}
+
+static ring * newRing(int64_t size)
+{
+    ring * r = allocate(sizeof(ring) + (size_t) size * sizeof(_Atomic(vfs_task *)));
+    r->size = size;
+
+    return r;
+}
+
+static void push(deque * d, vfs_task * task)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    ring * r = atomic_load_explicit(&d->ring, memory_order_relaxed);
+
+    if (b - t > r->size - 1) {
+        /* stealers may still read the old ring, so it is never freed. */
+        ring * larger = newRing(r->size * 2);
+
+        for (int64_t i = t; i < b; i++) {
+            atomic_store_explicit(&larger->tasks[i % larger->size],
+                    atomic_load_explicit(&r->tasks[i % r->size], memory_order_relaxed), memory_order_relaxed);
+        }
+
+        atomic_store_explicit(&d->ring, larger, memory_order_release);
+        r = larger;
+    }
+
+    atomic_store_explicit(&r->tasks[b % r->size], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+static vfs_task * take(deque * d)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    ring * r = atomic_load_explicit(&d->ring, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    vfs_task * task = atomic_load_explicit(&r->tasks[b % r->size], memory_order_relaxed);
+
+    if (t == b) {
+        /* the last task, which a stealer may be taking too. */
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                memory_order_seq_cst, memory_order_relaxed)) {
+            task = NULL;
+        }
+
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return task;
+}
+
+static vfs_task * steal(deque * d)
+{
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return NULL;
+    }
+
+    ring * r = atomic_load_explicit(&d->ring, memory_order_acquire);
+    vfs_task * task = atomic_load_explicit(&r->tasks[t % r->size], memory_order_relaxed);
+
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+
+    return task;
+}
+
+static vfs_task * takeShared(void)
+{
+    pthread_mutex_lock(&sharedLock);
+
+    vfs_task * task = sharedFirst;
+
+    if (task != NULL) {
+        sharedFirst = task->next;
+
+        if (sharedFirst == NULL) {
+            sharedLast = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&sharedLock);
+
+    return task;
+}
+
+static worker * randomVictim(void)
+{
+    /* xorshift, seeded by the thread. */
+    self->seed ^= self->seed << 13;
+    self->seed ^= self->seed >> 17;
+    self->seed ^= self->seed << 5;
+
+    int count = atomic_load_explicit(&workerCount, memory_order_acquire);
+    int index = (int) (self->seed % (unsigned) (count < MAX_WORKERS ? count : MAX_WORKERS));
+
+    /* the deque of a thread that is joining may not be there yet. */
+    return atomic_load_explicit(&workers[index], memory_order_acquire);
+}
+
+static vfs_task * find(void)
+{
+    if (atomic_load_explicit(&pending, memory_order_relaxed) == 0) {
+        return NULL;
+    }
+
+    vfs_task * task = self != NULL ? take(&self->tasks) : NULL;
+
+    if (task == NULL) {
+        task = takeShared();
+    }
+
+    for (int i = 0; task == NULL && self != NULL && i < 2 * workerCount; i++) {
+        worker * victim = randomVictim();
+
+        if (victim != NULL && victim != self) {
+            task = steal(&victim->tasks);
+        }
+    }
+
+    if (task != NULL) {
+        atomic_fetch_sub(&pending, 1);
+    }
+
+    return task;
+}
+
+static void run(vfs_task * task)
+{
+    task->run(FRAME(task));
+
+    if (atomic_exchange_explicit(&task->state, DONE, memory_order_acq_rel) == DETACHED) {
+        free(task);
+    }
+}
+
+static void join(void);
+
+static void * work(void * unused)
+{
+    (void) unused;
+    join();
+
+    for (int idle = 0; ; ) {
+        vfs_task * task = find();
+
+        if (task != NULL) {
+            run(task);
+            idle = 0;
+        } else if (++idle < 64) {
+            sched_yield();
+        } else {
+            /* a spawn either sees this sleeper, or is seen as pending before sleeping. */
+            pthread_mutex_lock(&sleepLock);
+            atomic_fetch_add(&sleepers, 1);
+
+            if (atomic_load(&pending) == 0) {
+                pthread_cond_wait(&wakeUp, &sleepLock);
+            }
+
+            atomic_fetch_sub(&sleepers, 1);
+            pthread_mutex_unlock(&sleepLock);
+
+            idle = 0;
+        }
+    }
+
+    return NULL;
+}
+
+static worker * newWorker(unsigned index)
+{
+    worker * w = allocate(sizeof(worker));
+
+    atomic_init(&w->tasks.top, 0);
+    atomic_init(&w->tasks.bottom, 0);
+    atomic_init(&w->tasks.ring, newRing(64));
+    w->seed = index * 2654435761u + 1;
+
+    return w;
+}
+
+/* gives the calling thread a deque, if there is room for it. */
+static void join(void)
+{
+    int index = atomic_fetch_add(&workerCount, 1);
+
+    if (index >= MAX_WORKERS) {
+        return;
+    }
+
+    self = newWorker((unsigned) index);
+    atomic_store_explicit(&workers[index], self, memory_order_release);
+}
+
+static void start(void)
+{
+    const char * threads = getenv("VFS_THREADS");
+    long count = threads != NULL ? atol(threads) : sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+    count = count < 1 ? 1 : count > MAX_WORKERS / 2 ? MAX_WORKERS / 2 : count;
+
+    for (long i = 0; i < count; i++) {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, work, NULL) != 0) {
+            fputs("vfs: cannot start task threads\n", stderr);
+            abort();
+        }
+
+        pthread_detach(thread);
+    }
+}
+
+void * vfs_task_new(int64_t size)
+{
+    vfs_task * task = allocate(HEADER + (size_t) size);
+    atomic_init(&task->state, RUNNING);
+    task->next = NULL;
+
+    return FRAME(task);
+}
+
+void vfs_task_spawn(void * frame, void (* run)(void *))
+{
+    pthread_once(&started, start);
+
+    if (self == NULL) {
+        join();
+    }
+
+    vfs_task * task = TASK(frame);
+    task->run = run;
+
+    atomic_fetch_add(&pending, 1);
+
+    if (self != NULL) {
+        push(&self->tasks, task);
+    } else {
+        pthread_mutex_lock(&sharedLock);
+
+        if (sharedLast != NULL) {
+            sharedLast->next = task;
+        } else {
+            sharedFirst = task;
+        }
+
+        sharedLast = task;
+
+        pthread_mutex_unlock(&sharedLock);
+    }
+
+    if (atomic_load(&sleepers) > 0) {
+        pthread_mutex_lock(&sleepLock);
+        pthread_cond_signal(&wakeUp);
+        pthread_mutex_unlock(&sleepLock);
+    }
+}
+
+void vfs_task_await(void * frame)
+{
+    /* the compiler clears a task variable once it is awaited. */
+    if (frame == NULL) {
+        fputs("vfs: a task is awaited twice\n", stderr);
+        abort();
+    }
+
+    vfs_task * awaited = TASK(frame);
+
+    while (atomic_load_explicit(&awaited->state, memory_order_acquire) != DONE) {
+        vfs_task * task = NULL;
+
+        if (depth < MAX_DEPTH) {
+            task = find();
+        } else if (self != NULL && (task = take(&self->tasks)) != NULL) {
+            atomic_fetch_sub(&pending, 1);
+        }
+
+        if (task != NULL) {
+            depth++;
+            run(task);
+            depth--;
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+void vfs_task_free(void * frame)
+{
+    free(TASK(frame));
+}
+
+void vfs_task_detach(void * frame)
+{
+    if (frame == NULL) {
+        return;
+    }
+
+    vfs_task * task = TASK(frame);
+
+    if (atomic_exchange_explicit(&task->state, DETACHED, memory_order_acq_rel) == DONE) {
+        free(task);
+    }
+}
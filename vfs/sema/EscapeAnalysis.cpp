@@ -0,0 +1,272 @@
+#include "EscapeAnalysis.hpp"
+
+#include "../type/Types.hpp"
+
+
+void EscapeAnalysis::enter(Function & function)
+{
+    current = &graphs[&function];
+    *current = Graph();
+}
+
+int EscapeAnalysis::add()
+{
+    int node = (int) current->parent.size();
+
+    current->parent.push_back(node);
+    current->escapes.push_back(false);
+
+    return node;
+}
+
+int EscapeAnalysis::find(Graph & graph, int node)
+{
+    while (graph.parent[node] != node) {
+        // halves the path on the way up.
+        graph.parent[node] = graph.parent[graph.parent[node]];
+        node = graph.parent[node];
+    }
+
+    return node;
+}
+
+int EscapeAnalysis::variable(int slot)
+{
+    auto it = current->variables.find(slot);
+
+    if (it != current->variables.end()) {
+        return it->second;
+    }
+
+    return current->variables[slot] = add();
+}
+
+bool EscapeAnalysis::isObject(Type * type)
+{
+    return type->isArray() || type->isStruct() || type->name == Symbol::get("atomic")
+            || type->name == Symbol::get("builder");
+}
+
+int EscapeAnalysis::origin(Expression * expression)
+{
+    auto type = expression->type;
+
+    if (type == nullptr || !isObject(type)) {
+        return -1;
+    }
+
+    if (auto identifier = dynamic_cast<Identifier *>(expression)) {
+        return variable(identifier->slot);
+    }
+
+    // what is read from an object was stored in it, so it moves with the object.
+    if (auto index = dynamic_cast<ArrayIndex *>(expression)) {
+        return variable(index->slot);
+    }
+
+    if (auto member = dynamic_cast<StructMember *>(expression)) {
+        return variable(member->slot);
+    }
+
+    if (auto array = dynamic_cast<Array *>(expression)) {
+        return current->literals[array];
+    }
+
+    // results of calls and tasks were made elsewhere, and are on the heap already.
+    return -1;
+}
+
+void EscapeAnalysis::declaration(VarDecl & node, bool fixed)
+{
+    current->sites.push_back({ &node.storage, variable(node.slot), -1, fixed });
+}
+
+void EscapeAnalysis::literal(Array & node)
+{
+    int site = current->literals[&node] = add();
+
+    for (auto element : node.elements) {
+        flow(site, origin(element));
+    }
+
+    current->sites.push_back({ &node.storage, site, -1, true });
+}
+
+void EscapeAnalysis::flow(int to, int from)
+{
+    if (to < 0 || from < 0) {
+        return;
+    }
+
+    to = find(*current, to);
+    from = find(*current, from);
+
+    if (to == from) {
+        return;
+    }
+
+    current->parent[from] = to;
+    current->escapes[to] = current->escapes[to] || current->escapes[from];
+}
+
+void EscapeAnalysis::assign(int slot, Expression * value)
+{
+    int from = origin(value);
+
+    if (from >= 0) {
+        flow(variable(slot), from);
+    }
+}
+
+void EscapeAnalysis::initialize(int slot, Expression * value)
+{
+    assign(slot, value);
+
+    if (auto array = dynamic_cast<Array *>(value)) {
+        for (auto & site : current->sites) {
+            if (site.storage == &array->storage) {
+                site.owner = variable(slot);
+            }
+        }
+    }
+}
+
+void EscapeAnalysis::escape(int node)
+{
+    if (node >= 0) {
+        current->escapes[find(*current, node)] = true;
+    }
+}
+
+void EscapeAnalysis::pass(int node, Function * callee, size_t index)
+{
+    if (node >= 0) {
+        current->arguments.push_back({ node, callee, index });
+    }
+}
+
+std::vector<bool> EscapeAnalysis::escaping(Graph & graph)
+{
+    std::vector<bool> escapes(graph.parent.size(), false);
+
+    for (size_t i = 0; i < graph.parent.size(); i++) {
+        if (graph.escapes[i]) {
+            escapes[find(graph, (int) i)] = true;
+        }
+    }
+
+    for (auto & argument : graph.arguments) {
+        auto & summary = argument.callee->escapingParameters;
+
+        // C may keep what it is given, and so may functions that are not solved yet.
+        if (argument.callee->isImported() || argument.index >= summary.size() || summary[argument.index]) {
+            escapes[find(graph, argument.node)] = true;
+        }
+    }
+
+    return escapes;
+}
+
+std::vector<int> EscapeAnalysis::parameters(Function & function, Graph & graph)
+{
+    std::vector<int> count(graph.parent.size(), 0);
+
+    // parameters are the first slots.
+    for (size_t i = 0; i < function.parameters.size(); i++) {
+        auto it = graph.variables.find((int) i);
+
+        if (it != graph.variables.end()) {
+            count[find(graph, it->second)]++;
+        }
+    }
+
+    return count;
+}
+
+void EscapeAnalysis::solve(const std::vector<Function *> & functions)
+{
+    std::vector<std::pair<Function *, Graph *>> solving;
+
+    // parameters start as not escaping, so functions that only pass objects to each other
+    // keep them on the stack.
+    for (auto function : functions) {
+        auto it = graphs.find(function);
+
+        if (it != graphs.end()) {
+            function->escapingParameters.assign(function->parameters.size(), false);
+            solving.push_back(std::make_pair(function, &it->second));
+        }
+    }
+
+    // parameters only ever start escaping, so this ends.
+    for (bool changed = true; changed; ) {
+        changed = false;
+
+        for (auto & i : solving) {
+            auto & function = *i.first;
+            auto & graph = *i.second;
+
+            auto escapes = escaping(graph);
+            auto held = parameters(function, graph);
+
+            std::vector<bool> summary(function.parameters.size(), false);
+
+            for (size_t p = 0; p < summary.size(); p++) {
+                auto it = graph.variables.find((int) p);
+
+                if (it != graph.variables.end()) {
+                    // stored in another parameter, the object is reachable by the caller.
+                    int root = find(graph, it->second);
+                    summary[p] = escapes[root] || held[root] > 1;
+                }
+            }
+
+            if (summary != function.escapingParameters) {
+                function.escapingParameters = summary;
+                changed = true;
+            }
+        }
+    }
+
+    for (auto & i : solving) {
+        place(*i.first, *i.second);
+    }
+}
+
+void EscapeAnalysis::place(Function & function, Graph & graph)
+{
+    auto escapes = escaping(graph);
+    auto held = parameters(function, graph);
+
+    std::vector<int> nodes(graph.parent.size(), 0);
+    std::vector<int> sites(graph.parent.size(), 0);
+
+    for (size_t i = 0; i < graph.parent.size(); i++) {
+        nodes[find(graph, (int) i)]++;
+    }
+
+    for (auto & site : graph.sites) {
+        sites[find(graph, site.node)]++;
+    }
+
+    for (auto & site : graph.sites) {
+        int root = find(graph, site.node);
+
+        // objects stored in a parameter are reachable by the caller.
+        if (escapes[root] || held[root] > 0) {
+            *site.storage = Storage::Heap;
+            continue;
+        }
+
+        // one slot in the entry block serves every time the object is made, which is only
+        // right if nothing else can hold the one made before.
+        bool alone = nodes[root] == 1
+                || (nodes[root] == 2 && site.owner >= 0 && find(graph, site.owner) == root);
+
+        if (site.fixed && alone && sites[root] == 1) {
+            *site.storage = Storage::Entry;
+        } else {
+            *site.storage = Storage::Stack;
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "../ast/SyntaxTree.hpp"
+
+
+/**
+ * Decides where the arrays, structs, atomics and builders that functions make live.
+ *
+ * The type checker reports how they move while it resolves a function: which variables and
+ * literals may hold the same object, which objects are returned or handed to a parameter,
+ * and which are stored in another object. Objects are merged into classes that move
+ * together, so a class escapes when any of its objects is reachable after the function
+ * returns. Escaping objects go on the heap. The others stay on the stack, and the ones only
+ * their own variable holds are allocated once in the entry block, where LLVM splits structs
+ * and small arrays into scalars.
+ *
+ * Whether a function lets the objects given to its parameters escape is kept in the
+ * function, so its callers can use it. Functions that call each other are solved together.
+ */
+class EscapeAnalysis
+{
+private:
+	// an object made by a declaration or a literal.
+	struct Site
+	{
+		Storage * storage;
+		int node;
+
+		// for literals, the variable they are the initial value of, -1 if none.
+		int owner;
+
+		// whether the size is known when compiling, as the entry block needs.
+		bool fixed;
+	};
+
+	// an object handed to a parameter of another function.
+	struct Argument
+	{
+		int node;
+		Function * callee;
+		size_t index;
+	};
+
+	// a node is a variable or a literal, and nodes that may hold the same object share a
+	// class, by union-find.
+	struct Graph
+	{
+		std::vector<int> parent;
+		std::vector<bool> escapes;
+
+		std::unordered_map<int, int> variables;
+		std::unordered_map<Array *, int> literals;
+
+		std::vector<Site> sites;
+		std::vector<Argument> arguments;
+	};
+
+	std::unordered_map<Function *, Graph> graphs;
+
+	Graph * current = nullptr;
+
+	int add();
+
+	/**
+	 * @return whether values of a type point to an object that a declaration or a literal
+	 * makes.
+	 */
+	bool isObject(Type * type);
+
+	int find(Graph & graph, int node);
+
+	/**
+	 * @return for each node that is the root of a class, whether the class escapes.
+	 */
+	std::vector<bool> escaping(Graph & graph);
+
+	/**
+	 * @return for each node that is the root of a class, how many parameters it holds.
+	 */
+	std::vector<int> parameters(Function & function, Graph & graph);
+
+	void place(Function & function, Graph & graph);
+
+public:
+	/**
+	 * Starts the graph of a function, before its parameters are checked.
+	 */
+	void enter(Function & function);
+
+	/**
+	 * Drops the graph of a function, which is about to be freed.
+	 */
+	void forget(Function * function)
+	{
+		graphs.erase(function);
+	}
+
+	void clear()
+	{
+		graphs.clear();
+		current = nullptr;
+	}
+
+	/**
+	 * @return the node of a variable of the current function.
+	 */
+	int variable(int slot);
+
+	/**
+	 * @return the node of the object an expression evaluates to, or -1 if it is not an object
+	 * of the current function.
+	 */
+	int origin(Expression * expression);
+
+	/**
+	 * Records a declaration that makes an array, struct, atomic or builder.
+	 */
+	void declaration(VarDecl & node, bool fixed);
+
+	/**
+	 * Records an array literal, whose elements were checked.
+	 */
+	void literal(Array & node);
+
+	/**
+	 * Records that the object of one node may be held by another.
+	 */
+	void flow(int to, int from);
+
+	/**
+	 * Records that a variable, or an object it points to, may hold the given value.
+	 */
+	void assign(int slot, Expression * value);
+
+	/**
+	 * Records the initial value of a declared variable.
+	 */
+	void initialize(int slot, Expression * value);
+
+	/**
+	 * Records that the object of a node is reachable after the function returns.
+	 */
+	void escape(int node);
+
+	/**
+	 * Records that the object of a node is passed to a parameter of a function.
+	 */
+	void pass(int node, Function * callee, size_t index);
+
+	/**
+	 * Decides where the objects of the given functions live, and what their parameters let
+	 * escape. Functions that were not entered are skipped.
+	 */
+	void solve(const std::vector<Function *> & functions);
+};
@@ -0,0 +1,833 @@
+#include "TypeChecker.hpp"
+
+#include <algorithm>
+#include <set>
+
+#include "../type/Types.hpp"
+
+
+TypeChecker::TypeChecker(Arena & arena) : arena(arena)
+{
+    intType = arena.make<Type>(Symbol::get("int"));
+    floatType = arena.make<Type>(Symbol::get("float"));
+    boolType = arena.make<Type>(Symbol::get("bool"));
+    stringType = arena.make<Type>(Symbol::get("string"));
+    builderType = arena.make<Type>(Symbol::get("builder"));
+    byteType = arena.make<Type>(Symbol::get("byte"));
+    fileType = arena.make<Type>(Symbol::get("file"));
+    atomicType = arena.make<Type>(Symbol::get("atomic"));
+    queueType = arena.make<Type>(Symbol::get("queue"));
+    counterType = arena.make<Type>(Symbol::get("counter"));
+    voidType = arena.make<Type>(Symbol::get("void"));
+
+    builtins[Symbol::get("Print.format")] = intType;
+
+    builtins[Symbol::get("String.length")] = intType;
+    builtinParameters[Symbol::get("String.length")] = { stringType };
+
+    builtins[Symbol::get("Builder.append")] = voidType;
+    builtinParameters[Symbol::get("Builder.append")] = { builderType, nullptr };
+
+    builtins[Symbol::get("Builder.string")] = stringType;
+    builtinParameters[Symbol::get("Builder.string")] = { builderType };
+
+    auto bytes = arena.make<ArrayType>(byteType, nullptr);
+
+    builtins[Symbol::get("File.map")] = bytes;
+    builtinParameters[Symbol::get("File.map")] = { stringType };
+
+    builtins[Symbol::get("File.size")] = intType;
+    builtinParameters[Symbol::get("File.size")] = { bytes };
+
+    builtins[Symbol::get("File.create")] = fileType;
+    builtinParameters[Symbol::get("File.create")] = { stringType };
+
+    builtins[Symbol::get("File.stdout")] = fileType;
+    builtinParameters[Symbol::get("File.stdout")] = {};
+
+    builtins[Symbol::get("File.write")] = voidType;
+    builtinParameters[Symbol::get("File.write")] = { fileType, nullptr };
+
+    builtins[Symbol::get("File.copy")] = voidType;
+    builtinParameters[Symbol::get("File.copy")] = { fileType, bytes, intType, intType };
+
+    builtins[Symbol::get("File.flush")] = voidType;
+    builtinParameters[Symbol::get("File.flush")] = { fileType };
+
+    builtins[Symbol::get("File.close")] = voidType;
+    builtinParameters[Symbol::get("File.close")] = { fileType };
+
+    std::vector<std::string> anyOrdering = { "relaxed", "acquire", "release", "acq_rel", "seq_cst" };
+
+    builtins[Symbol::get("Atomic.load")] = intType;
+    builtinParameters[Symbol::get("Atomic.load")] = { atomicType };
+    builtinOrderings[Symbol::get("Atomic.load")] = { "relaxed", "acquire", "seq_cst" };
+
+    builtins[Symbol::get("Atomic.store")] = voidType;
+    builtinParameters[Symbol::get("Atomic.store")] = { atomicType, intType };
+    builtinOrderings[Symbol::get("Atomic.store")] = { "relaxed", "release", "seq_cst" };
+
+    for (auto name : { "Atomic.add", "Atomic.sub", "Atomic.swap", "Atomic.min", "Atomic.max" }) {
+        builtins[Symbol::get(name)] = intType;
+        builtinParameters[Symbol::get(name)] = { atomicType, intType };
+        builtinOrderings[Symbol::get(name)] = anyOrdering;
+    }
+
+    builtins[Symbol::get("Atomic.cas")] = boolType;
+    builtinParameters[Symbol::get("Atomic.cas")] = { atomicType, intType, intType };
+    builtinOrderings[Symbol::get("Atomic.cas")] = anyOrdering;
+
+    builtins[Symbol::get("Atomic.fence")] = voidType;
+    builtinParameters[Symbol::get("Atomic.fence")] = {};
+    builtinOrderings[Symbol::get("Atomic.fence")] = { "acquire", "release", "acq_rel", "seq_cst" };
+
+    builtins[Symbol::get("Queue.new")] = queueType;
+    builtinParameters[Symbol::get("Queue.new")] = { intType };
+
+    builtins[Symbol::get("Queue.push")] = voidType;
+    builtinParameters[Symbol::get("Queue.push")] = { queueType, intType };
+
+    builtins[Symbol::get("Queue.offer")] = boolType;
+    builtinParameters[Symbol::get("Queue.offer")] = { queueType, intType };
+
+    builtins[Symbol::get("Queue.pop")] = intType;
+    builtinParameters[Symbol::get("Queue.pop")] = { queueType };
+
+    builtins[Symbol::get("Queue.poll")] = intType;
+    builtinParameters[Symbol::get("Queue.poll")] = { queueType, intType };
+
+    builtins[Symbol::get("Counter.new")] = counterType;
+    builtinParameters[Symbol::get("Counter.new")] = {};
+
+    builtins[Symbol::get("Counter.add")] = voidType;
+    builtinParameters[Symbol::get("Counter.add")] = { counterType, intType };
+
+    builtins[Symbol::get("Counter.sum")] = intType;
+    builtinParameters[Symbol::get("Counter.sum")] = { counterType };
+}
+
+void TypeChecker::declare(const std::vector<Function *> & program,
+        const std::vector<Struct *> & structs)
+{
+    for (auto s : structs) {
+        s->check(this);
+    }
+
+    for (auto f : program) {
+        auto it = functions.insert(std::make_pair(f->getVirtualName(), f));
+
+        if (!it.second && it.first->second != f) {
+            throw std::runtime_error("Function already defined: " + f->getVirtualName().str());
+        }
+    }
+}
+
+void TypeChecker::check(const std::vector<Function *> & program,
+        const std::vector<Struct *> & structs)
+{
+    declare(program, structs);
+
+    for (auto f : program) {
+        f->check(this);
+    }
+
+    // the functions of a unit may call each other, so they are solved again together.
+    escape.solve(program);
+    escape.clear();
+}
+
+int TypeChecker::addLocal(Symbol name, Type * type)
+{
+    int slot = (int) current->locals.size();
+
+    scope().add(name, slot);
+    current->locals.push_back({ name, type });
+
+    return slot;
+}
+
+int TypeChecker::getSlot(Symbol name)
+{
+    int slot = scope().get(name);
+
+    if (slot < 0) {
+        throw std::runtime_error("Symbol not defined: " + name.str());
+    }
+
+    return slot;
+}
+
+Struct * TypeChecker::getStruct(int slot, Symbol variable)
+{
+    auto type = current->locals[slot].type;
+
+    if (!type->isStruct()) {
+        throw std::runtime_error("This is not a struct: " + variable.str());
+    }
+
+    auto it = structs.find(type->name);
+
+    if (it == structs.end()) {
+        throw std::runtime_error("Struct not defined: " + type->name.str());
+    }
+
+    return it->second;
+}
+
+int TypeChecker::getMemberIndex(Struct * node, Symbol member)
+{
+    for (size_t i = 0; i < node->members.size(); i++) {
+        if (node->members[i]->name == member) {
+            return (int) i;
+        }
+    }
+
+    throw std::runtime_error("Struct " + node->name.str() + " has no member " + member.str());
+}
+
+bool TypeChecker::isNumeric(Type * type)
+{
+    return type->equals(intType) || type->equals(floatType) || type->equals(byteType);
+}
+
+void TypeChecker::expect(Type * from, Type * to, std::string what)
+{
+    if (from->equals(to) || (isNumeric(from) && isNumeric(to))) {
+        return;
+    }
+
+    throw std::runtime_error("Cannot use " + from->str() + " as " + to->str() + " in " + what);
+}
+
+Type * TypeChecker::call(Function * target, std::vector<Expression *> & arguments)
+{
+    auto name = target->getVirtualName().str();
+
+    if (arguments.size() != target->parameters.size()) {
+        throw std::runtime_error("Wrong number of arguments for " + name);
+    }
+
+    for (size_t i = 0; i < arguments.size(); i++) {
+        expect(arguments[i]->check(this), target->parameters[i]->type, "call to " + name);
+        escape.pass(escape.origin(arguments[i]), target, i);
+    }
+
+    return target->type;
+}
+
+Type * TypeChecker::visit(Struct & node)
+{
+    auto it = structs.insert(std::make_pair(node.name, &node));
+
+    if (!it.second && it.first->second->members.size() != node.members.size()) {
+        throw std::runtime_error("Struct type redefined with different members: " + node.name.str());
+    }
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Function & node)
+{
+    if (!node.external.empty()) {
+        checkExternal(node);
+    }
+
+    // functions imported from C have nothing to check but their signature.
+    if (node.isImported()) {
+        return node.type;
+    }
+
+    current = &node;
+    node.locals.clear();
+
+    // a function can be checked again after a failed attempt.
+    scopes.clear();
+    loops = 0;
+    awaiting = false;
+
+    createScope();
+    escape.enter(node);
+
+    for (auto parameter : node.parameters) {
+        parameter->check(this);
+    }
+
+    node.block->check(this);
+
+    popScope();
+
+    // functions checked one at a time are solved with what is known of their callees.
+    escape.solve({ &node });
+
+    return node.type;
+}
+
+void TypeChecker::checkExternal(Function & node)
+{
+    auto name = node.getVirtualName().str();
+
+    // C gets the characters of a string, which it can read but not keep or make.
+    if (node.type->equals(stringType)) {
+        throw std::runtime_error("Functions shared with C cannot return strings: " + name);
+    }
+
+    for (auto parameter : node.parameters) {
+        if (parameter->type->equals(stringType) && !node.isImported()) {
+            throw std::runtime_error("Functions exported to C cannot take strings: " + name);
+        }
+    }
+}
+
+Type * TypeChecker::visit(Parameter & node)
+{
+    node.slot = addLocal(node.name, node.type);
+    return node.type;
+}
+
+Type * TypeChecker::visit(Block & node)
+{
+    for (auto i : node.statements) {
+        i->check(this);
+    }
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(VarDecl & node)
+{
+    Type * type = node.type;
+
+    if (type != nullptr && (type->isArray() || type->isStruct() || type->equals(builderType)
+            || type->equals(atomicType))) {
+        // declared arrays, structs, builders and atomics are allocated by the declaration itself.
+        if (node.expression != nullptr) {
+            throw std::runtime_error("Variable " + node.name.str() + " of type " + type->str()
+                    + " cannot have an initial value");
+        }
+
+        if (type->isArray()) {
+            expect(static_cast<ArrayType *>(type)->size->check(this), intType, "array size");
+        } else if (type->isStruct() && structs.find(type->name) == structs.end()) {
+            throw std::runtime_error("Struct not defined: " + type->name.str());
+        }
+    } else if (node.expression != nullptr) {
+        auto initial = node.expression->check(this);
+
+        if (type == nullptr) {
+            type = initial;
+        } else {
+            expect(initial, type, "declaration of " + node.name.str());
+        }
+    }
+
+    if (type == nullptr) {
+        throw std::runtime_error("Variable type inference needs a definition.");
+    }
+
+    if (type->equals(voidType)) {
+        throw std::runtime_error("Variable cannot be void: " + node.name.str());
+    }
+
+    node.slot = addLocal(node.name, type);
+
+    if (node.type != nullptr && (node.type->isArray() || node.type->isStruct()
+            || node.type->equals(atomicType) || node.type->equals(builderType))) {
+        // the entry block can only hold arrays of a size known now.
+        bool fixed = !node.type->isArray()
+                || dynamic_cast<Integer *>(static_cast<ArrayType *>(node.type)->size) != nullptr;
+
+        escape.declaration(node, fixed);
+    } else if (node.expression != nullptr) {
+        escape.initialize(node.slot, node.expression);
+    }
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Assignment & node)
+{
+    node.slot = getSlot(node.variable);
+    expect(node.expression->check(this), current->locals[node.slot].type,
+            "assignment to " + node.variable.str());
+
+    escape.assign(node.slot, node.expression);
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(ArrayAssignment & node)
+{
+    node.slot = getSlot(node.variable);
+    auto type = current->locals[node.slot].type;
+
+    if (!type->isArray()) {
+        throw std::runtime_error("This is not an array: " + node.variable.str());
+    }
+
+    expect(node.expression->check(this), static_cast<ArrayType *>(type)->element,
+            "assignment to " + node.variable.str());
+    expect(node.index->check(this), intType, "array index");
+
+    // what is stored in an array lives as long as the array.
+    escape.assign(node.slot, node.expression);
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(StructAssignment & node)
+{
+    node.slot = getSlot(node.variable);
+
+    auto structNode = getStruct(node.slot, node.variable);
+    node.index = getMemberIndex(structNode, node.member);
+
+    expect(node.expression->check(this), structNode->members[node.index]->type,
+            "assignment to " + node.variable.str() + "." + node.member.str());
+
+    escape.assign(node.slot, node.expression);
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(VersionInv & node)
+{
+    auto name = node.getVirtualName(current->name);
+    auto it = functions.find(name);
+
+    if (it == functions.end()) {
+        throw UndeclaredFunction(name);
+    }
+
+    node.target = it->second;
+    return node.type = call(node.target, node.arguments);
+}
+
+Type * TypeChecker::visit(FunctionCall & node)
+{
+    auto it = functions.find(node.getVirtualName());
+
+    if (it != functions.end()) {
+        node.target = it->second;
+        return node.type = call(node.target, node.arguments);
+    }
+
+    auto builtin = builtins.find(node.getVirtualName());
+
+    if (builtin == builtins.end()) {
+        throw UndeclaredFunction(node.getVirtualName());
+    }
+
+    auto parameters = builtinParameters.find(node.getVirtualName());
+
+    if (parameters == builtinParameters.end()) {
+        for (auto i : node.arguments) {
+            i->check(this);
+        }
+
+        return node.type = builtin->second;
+    }
+
+    auto name = node.getVirtualName().str();
+    auto count = node.arguments.size();
+
+    if (builtinOrderings.count(node.getVirtualName()) && count == parameters->second.size() + 1) {
+        checkOrdering(node.arguments.back(), node.getVirtualName());
+        count--;
+    }
+
+    if (count != parameters->second.size()) {
+        throw std::runtime_error("Wrong number of arguments for " + name);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        auto type = node.arguments[i]->check(this);
+        auto parameter = parameters->second[i];
+
+        if (parameter != nullptr) {
+            expect(type, parameter, "call to " + name);
+        } else if (!isNumeric(type) && !type->equals(boolType) && !type->equals(stringType)) {
+            throw std::runtime_error("Cannot use " + type->str() + " in call to " + name);
+        }
+    }
+
+    return node.type = builtin->second;
+}
+
+void TypeChecker::checkOrdering(Expression * ordering, Symbol builtin)
+{
+    auto literal = dynamic_cast<String *>(ordering);
+
+    if (literal == nullptr) {
+        throw std::runtime_error("Memory ordering of " + builtin.str() + " has to be a string literal");
+    }
+
+    auto & allowed = builtinOrderings[builtin];
+
+    if (std::find(allowed.begin(), allowed.end(), literal->value) == allowed.end()) {
+        throw std::runtime_error("Memory ordering " + literal->value + " cannot be used by " + builtin.str());
+    }
+
+    ordering->check(this);
+}
+
+Type * TypeChecker::visit(Return & node)
+{
+    auto returnType = current->type;
+
+    if (node.expression == nullptr) {
+        if (!returnType->equals(voidType)) {
+            throw std::runtime_error("Missing return value in " + current->getVirtualName().str());
+        }
+
+        return nullptr;
+    }
+
+    auto type = node.expression->check(this);
+
+    // a void function can return the result of another void function.
+    if (returnType->equals(voidType)) {
+        if (!type->equals(voidType)) {
+            throw std::runtime_error("Cannot return a value from " + current->getVirtualName().str());
+        }
+    } else {
+        expect(type, returnType, "return of " + current->getVirtualName().str());
+    }
+
+    escape.escape(escape.origin(node.expression));
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(ExpressionStatement & node)
+{
+    node.expression->check(this);
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Identifier & node)
+{
+    node.slot = getSlot(node.name);
+    node.type = current->locals[node.slot].type;
+
+    // copies of a task could be awaited after its frame is freed.
+    if (node.type->isTask() && !awaiting) {
+        throw std::runtime_error("Tasks can only be awaited: " + node.name.str());
+    }
+
+    return node.type;
+}
+
+Type * TypeChecker::visit(Integer & node)
+{
+    return node.type = intType;
+}
+
+Type * TypeChecker::visit(Float & node)
+{
+    return node.type = floatType;
+}
+
+Type * TypeChecker::visit(String & node)
+{
+    return node.type = stringType;
+}
+
+Type * TypeChecker::visit(Bool & node)
+{
+    return node.type = boolType;
+}
+
+Type * TypeChecker::visit(BinaryOp & node)
+{
+    auto left = node.left->check(this);
+    auto right = node.right->check(this);
+
+    Type * operands = nullptr;
+
+    if (left->equals(right)) {
+        operands = left;
+    } else if (isNumeric(left) && isNumeric(right)) {
+        // bytes widen to ints, and ints to floats.
+        operands = left->equals(floatType) || right->equals(floatType) ? floatType : intType;
+    } else {
+        throw std::runtime_error("No conversion between " + left->str() + " and " + right->str());
+    }
+
+    if (!isMathOperator(node.op)) {
+        bool equality = node.op == Operator::Eq || node.op == Operator::Neq;
+
+        if (!isNumeric(operands) && !(equality && operands->equals(boolType))) {
+            throw std::runtime_error("Not a comparison operator for type " + operands->str());
+        }
+
+        return node.type = boolType;
+    }
+
+    // strings are concatenated.
+    if (node.op == Operator::Add && operands->equals(stringType)) {
+        return node.type = stringType;
+    }
+
+    if (!isNumeric(operands)) {
+        throw std::runtime_error("Not a math operator for type " + operands->str());
+    }
+
+    return node.type = operands;
+}
+
+Type * TypeChecker::visit(Logical & node)
+{
+    auto what = node.conjunction ? "&&" : "||";
+
+    expect(node.left->check(this), boolType, what);
+    expect(node.right->check(this), boolType, what);
+
+    return node.type = boolType;
+}
+
+Type * TypeChecker::visit(Not & node)
+{
+    expect(node.operand->check(this), boolType, "!");
+
+    return node.type = boolType;
+}
+
+Type * TypeChecker::visit(If & node)
+{
+    expect(node.condition->check(this), boolType, "condition");
+
+    createScope();
+    node.thenBlock->check(this);
+    popScope();
+
+    if (node.elseBlock) {
+        createScope();
+        node.elseBlock->check(this);
+        popScope();
+    }
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Match & node)
+{
+    auto subject = node.subject->check(this);
+    bool strings = subject->equals(stringType);
+
+    if (!strings && !subject->equals(intType) && !subject->equals(byteType)) {
+        throw std::runtime_error("Cannot match a value of type " + subject->str());
+    }
+
+    // the generator relies on every value being taken by one case at most.
+    std::set<int> integers;
+    std::set<std::string> texts;
+
+    for (auto & arm : node.cases) {
+        for (auto value : arm.values) {
+            expect(value->check(this), subject, "match case");
+
+            if (strings && !texts.insert(static_cast<String *>(value)->value).second) {
+                throw std::runtime_error("Duplicate case in match: \"" + static_cast<String *>(value)->value + "\"");
+            }
+
+            if (strings) {
+                continue;
+            }
+
+            int integer = static_cast<Integer *>(value)->value;
+
+            if (subject->equals(byteType) && (integer < 0 || integer > 255)) {
+                throw std::runtime_error("Case out of range for byte: " + std::to_string(integer));
+            }
+
+            if (!integers.insert(integer).second) {
+                throw std::runtime_error("Duplicate case in match: " + std::to_string(integer));
+            }
+        }
+
+        createScope();
+        arm.block->check(this);
+        popScope();
+    }
+
+    if (node.otherwise) {
+        createScope();
+        node.otherwise->check(this);
+        popScope();
+    }
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Print & node)
+{
+    auto type = node.expression->check(this);
+
+    if (type->equals(voidType)) {
+        throw std::runtime_error("Cannot print a void value");
+    }
+
+    if (type->isTask()) {
+        throw std::runtime_error("Cannot print a task");
+    }
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(For & node)
+{
+    // the counter is only visible inside the loop.
+    createScope();
+
+    expect(node.initial->check(this), intType, "for counter");
+    node.slot = addLocal(node.variable, intType);
+
+    expect(node.condition->check(this), boolType, "for condition");
+    expect(node.increment->check(this), intType, "for increment");
+
+    createScope();
+    loops++;
+    node.block->check(this);
+    loops--;
+    popScope();
+
+    popScope();
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(While & node)
+{
+    expect(node.condition->check(this), boolType, "while condition");
+
+    createScope();
+    loops++;
+    node.block->check(this);
+    loops--;
+    popScope();
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Range & node)
+{
+    // the bounds are checked before the counter exists, so they cannot use it.
+    createScope();
+
+    expect(node.from->check(this), intType, "range start");
+    expect(node.to->check(this), intType, "range end");
+    expect(node.step->check(this), intType, "range step");
+
+    // ranges only count up, which the generator relies on. Other steps are checked when the
+    // loop starts.
+    auto step = dynamic_cast<Integer *>(node.step);
+
+    if (step != nullptr && step->value <= 0) {
+        throw std::runtime_error("Range step has to be positive");
+    }
+
+    node.slot = addLocal(node.variable, intType);
+
+    createScope();
+    loops++;
+    node.block->check(this);
+    loops--;
+    popScope();
+
+    popScope();
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Break & node)
+{
+    if (loops == 0) {
+        throw std::runtime_error("Cannot break outside of a loop");
+    }
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Continue & node)
+{
+    if (loops == 0) {
+        throw std::runtime_error("Cannot continue outside of a loop");
+    }
+
+    return nullptr;
+}
+
+Type * TypeChecker::visit(Array & node)
+{
+    if (node.elements.empty()) {
+        throw std::runtime_error("Array literals cannot be empty");
+    }
+
+    auto element = node.elements[0]->check(this);
+
+    if (element->isTask()) {
+        throw std::runtime_error("Tasks cannot be kept in arrays");
+    }
+
+    for (size_t i = 1; i < node.elements.size(); i++) {
+        expect(node.elements[i]->check(this), element, "array literal");
+    }
+
+    escape.literal(node);
+
+    auto size = arena.make<Integer>((int) node.elements.size());
+    return node.type = arena.make<ArrayType>(element, size);
+}
+
+Type * TypeChecker::visit(ArrayIndex & node)
+{
+    node.slot = getSlot(node.name);
+    auto type = current->locals[node.slot].type;
+
+    if (!type->isArray()) {
+        throw std::runtime_error("This is not an array: " + node.name.str());
+    }
+
+    expect(node.expression->check(this), intType, "array index");
+
+    return node.type = static_cast<ArrayType *>(type)->element;
+}
+
+Type * TypeChecker::visit(StructMember & node)
+{
+    node.slot = getSlot(node.variable);
+
+    auto structNode = getStruct(node.slot, node.variable);
+    node.index = getMemberIndex(structNode, node.member);
+
+    return node.type = structNode->members[node.index]->type;
+}
+
+Type * TypeChecker::visit(Spawn & node)
+{
+    auto result = node.call->check(this);
+
+    if (node.call->target == nullptr) {
+        throw std::runtime_error("Builtins cannot be spawned: " + node.call->getVirtualName().str());
+    }
+
+    // the task may still use its arguments after the function returns.
+    for (auto argument : node.call->arguments) {
+        escape.escape(escape.origin(argument));
+    }
+
+    return node.type = arena.make<TaskType>(result);
+}
+
+Type * TypeChecker::visit(Await & node)
+{
+    awaiting = dynamic_cast<Identifier *>(node.task) != nullptr;
+    auto type = node.task->check(this);
+    awaiting = false;
+
+    if (!type->isTask()) {
+        throw std::runtime_error("Cannot await " + type->str());
+    }
+
+    return node.type = static_cast<TaskType *>(type)->result;
+}
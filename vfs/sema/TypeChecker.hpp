@@ -0,0 +1,201 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../ast/SyntaxTree.hpp"
+#include "../context/Arena.hpp"
+#include "../context/Scope.hpp"
+#include "EscapeAnalysis.hpp"
+
+
+/**
+ * Thrown when a call names a function that is not declared, or not declared yet.
+ */
+struct UndeclaredFunction : std::runtime_error
+{
+	Symbol name;
+
+	UndeclaredFunction(Symbol name) :
+		std::runtime_error("Function not defined: " + name.str()), name(name) {}
+};
+
+/**
+ * Resolves the syntax tree of a unit before it is generated.
+ *
+ * Every expression gets its type, every variable a slot in its function, every call its
+ * target, every struct access the index of its member and every array and struct the
+ * storage its escape analysis finds. The generator only reads these,
+ * so it never has to look at the values it emits to learn what they are.
+ */
+class TypeChecker
+{
+private:
+	// the types made by the checker belong to the unit, like the rest of its tree.
+	Arena & arena;
+
+	Type * intType;
+	Type * floatType;
+	Type * boolType;
+	Type * stringType;
+	Type * builderType;
+	Type * byteType;
+	Type * fileType;
+	Type * atomicType;
+	Type * queueType;
+	Type * counterType;
+	Type * voidType;
+
+	// every function and struct that can be used, by virtual name and by name.
+	std::unordered_map<Symbol, Function *> functions;
+	std::unordered_map<Symbol, Struct *> structs;
+
+	// functions the generator provides, with their return type.
+	std::unordered_map<Symbol, Type *> builtins;
+
+	// the parameters of builtins whose arguments are checked. A null parameter takes any
+	// number, bool or string.
+	std::unordered_map<Symbol, std::vector<Type *>> builtinParameters;
+
+	// the memory orderings builtins of atomics take after their parameters, by their C11
+	// names. Leaving the ordering out is seq_cst.
+	std::unordered_map<Symbol, std::vector<std::string>> builtinOrderings;
+
+	Function * current = nullptr;
+
+	// how many loops the statement being checked is in, so break and continue have one.
+	int loops = 0;
+
+	// whether the identifier being checked is awaited, the only use a task variable has.
+	bool awaiting = false;
+
+	EscapeAnalysis escape;
+
+	std::vector<std::shared_ptr<Scope>> scopes;
+
+	void createScope()
+	{
+		Scope * parent = nullptr;
+
+		if (!scopes.empty()) {
+			parent = scopes.back().get();
+		}
+
+		scopes.push_back(std::make_shared<Scope>(parent));
+	}
+
+	Scope & scope()
+	{
+		return *scopes.back();
+	}
+
+	void popScope()
+	{
+		scopes.pop_back();
+	}
+
+	/**
+	 * Adds a variable to the current function and scope.
+	 *
+	 * @return the slot of the variable.
+	 */
+	int addLocal(Symbol name, Type * type);
+
+	/**
+	 * @return the slot of a visible variable. Throws if there is none.
+	 */
+	int getSlot(Symbol name);
+
+	/**
+	 * @return the struct a variable points to. Throws if it is not a struct.
+	 */
+	Struct * getStruct(int slot, Symbol variable);
+
+	/**
+	 * @return the index of a member in the struct. Throws if it has no such member.
+	 */
+	int getMemberIndex(Struct * node, Symbol member);
+
+	bool isNumeric(Type * type);
+
+	/**
+	 * Throws if a value of the first type cannot be stored where the second one is expected.
+	 * Numbers are casted into each other, everything else has to match.
+	 */
+	void expect(Type * from, Type * to, std::string what);
+
+	Type * call(Function * target, std::vector<Expression *> & arguments);
+
+	/**
+	 * Throws if the memory ordering given to a builtin is not a string literal, or not one
+	 * the builtin takes.
+	 */
+	void checkOrdering(Expression * ordering, Symbol builtin);
+
+	/**
+	 * Throws if the signature of a function imported from or exported to C has values C
+	 * cannot share.
+	 */
+	void checkExternal(Function & node);
+
+public:
+	TypeChecker(Arena & arena);
+
+	/**
+	 * Makes the functions and structs of a unit known, without checking their bodies.
+	 */
+	void declare(const std::vector<Function *> & program,
+			const std::vector<Struct *> & structs);
+
+	/**
+	 * Changes the node a declared function is known by, so the node it had can be freed.
+	 */
+	void redeclare(Function * declaration)
+	{
+		escape.forget(functions[declaration->getVirtualName()]);
+		functions[declaration->getVirtualName()] = declaration;
+	}
+
+	/**
+	 * Declares a unit and checks every one of its functions.
+	 */
+	void check(const std::vector<Function *> & program,
+			const std::vector<Struct *> & structs);
+
+	Type * visit(Block & node);
+	Type * visit(Struct & node);
+	Type * visit(Function & node);
+	Type * visit(Parameter & node);
+	Type * visit(VarDecl & node);
+	Type * visit(VersionInv & node);
+	Type * visit(FunctionCall & node);
+	Type * visit(Float & node);
+	Type * visit(Integer & node);
+	Type * visit(String & node);
+	Type * visit(BinaryOp & node);
+	Type * visit(Logical & node);
+	Type * visit(Not & node);
+	Type * visit(Identifier & node);
+	Type * visit(Return & node);
+	Type * visit(ExpressionStatement & node);
+	Type * visit(Assignment & node);
+	Type * visit(If & node);
+	Type * visit(Match & node);
+	Type * visit(Print & node);
+	Type * visit(Array & node);
+	Type * visit(ArrayIndex & node);
+	Type * visit(StructMember & node);
+	Type * visit(ArrayAssignment & node);
+	Type * visit(StructAssignment & node);
+	Type * visit(For & node);
+	Type * visit(While & node);
+	Type * visit(Range & node);
+	Type * visit(Break & node);
+	Type * visit(Continue & node);
+	Type * visit(Bool & node);
+	Type * visit(Spawn & node);
+	Type * visit(Await & node);
+};
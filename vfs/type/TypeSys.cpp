@@ -1,10 +1,31 @@
 #include <llvm/IR/Value.h>
+#include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/InstrTypes.h>
+
+#include <algorithm>
+#include <iterator>
+
 #include "TypeSys.hpp"
 
-TypeSys::TypeSys()
+TypeSys::TypeSys(llvm::LLVMContext & context) :
+        floatTy(llvm::Type::getFloatTy(context)),
+        intTy(llvm::Type::getInt32Ty(context)),
+        charTy(llvm::Type::getInt8Ty(context)),
+        doubleTy(llvm::Type::getDoubleTy(context)),
+        boolTy(llvm::Type::getInt1Ty(context)),
+        voidTy(llvm::Type::getVoidTy(context)),
+        byteTy(llvm::Type::getInt8Ty(context)),
+        atomicTy(llvm::Type::getInt32Ty(context)),
+        stringTy(llvm::StructType::get(context, {
+                llvm::Type::getInt64Ty(context), llvm::Type::getInt8PtrTy(context), llvm::Type::getInt64Ty(context)
+        })),
+        builderTy(llvm::StructType::get(context, {
+                llvm::Type::getInt8PtrTy(context), llvm::Type::getInt64Ty(context), llvm::Type::getInt64Ty(context)
+        }))
 {
     addCoercion(intTy, floatTy, floatTy);
+    addCoercion(byteTy, intTy, intTy);
+    addCoercion(byteTy, floatTy, floatTy);
 
     addCast(intTy, floatTy, llvm::CastInst::SIToFP);
     addCast(intTy, doubleTy, llvm::CastInst::SIToFP);
@@ -12,26 +33,82 @@ TypeSys::TypeSys()
     addCast(floatTy, doubleTy, llvm::CastInst::FPExt);
     addCast(floatTy, intTy, llvm::CastInst::FPToSI);
     addCast(doubleTy, intTy, llvm::CastInst::FPToSI);
+    addCast(byteTy, intTy, llvm::CastInst::ZExt);
+    addCast(byteTy, floatTy, llvm::CastInst::UIToFP);
+    addCast(byteTy, doubleTy, llvm::CastInst::UIToFP);
+    addCast(intTy, byteTy, llvm::CastInst::Trunc);
+    addCast(floatTy, byteTy, llvm::CastInst::FPToUI);
+
+    for (auto & row : mathOpTab) {
+        std::fill(std::begin(row), std::end(row), llvm::Instruction::BinaryOpsEnd);
+    }
 
-    addOp(intTy, "+", llvm::Instruction::Add);
-    addOp(floatTy, "+", llvm::Instruction::FAdd);
-    addOp(doubleTy, "+", llvm::Instruction::FAdd);
-
-    addOp(intTy, "-", llvm::Instruction::Sub);
-    addOp(floatTy, "-", llvm::Instruction::FSub);
-    addOp(doubleTy, "-", llvm::Instruction::FSub);
-
-    addOp(intTy, "*", llvm::Instruction::Mul);
-    addOp(floatTy, "*", llvm::Instruction::FMul);
-    addOp(doubleTy, "*", llvm::Instruction::FMul);
+    for (auto & row : cmpTab) {
+        std::fill(std::begin(row), std::end(row), llvm::CmpInst::BAD_ICMP_PREDICATE);
+    }
 
-    addOp(intTy, "/", llvm::Instruction::SDiv);
-    addOp(floatTy, "/", llvm::Instruction::FDiv);
-    addOp(doubleTy, "/", llvm::Instruction::FDiv);
+    addOp(intTy, Operator::Add, llvm::Instruction::Add);
+    addOp(byteTy, Operator::Add, llvm::Instruction::Add);
+    addOp(floatTy, Operator::Add, llvm::Instruction::FAdd);
+    addOp(doubleTy, Operator::Add, llvm::Instruction::FAdd);
+
+    addOp(intTy, Operator::Sub, llvm::Instruction::Sub);
+    addOp(byteTy, Operator::Sub, llvm::Instruction::Sub);
+    addOp(floatTy, Operator::Sub, llvm::Instruction::FSub);
+    addOp(doubleTy, Operator::Sub, llvm::Instruction::FSub);
+
+    addOp(intTy, Operator::Mul, llvm::Instruction::Mul);
+    addOp(byteTy, Operator::Mul, llvm::Instruction::Mul);
+    addOp(floatTy, Operator::Mul, llvm::Instruction::FMul);
+    addOp(doubleTy, Operator::Mul, llvm::Instruction::FMul);
+
+    addOp(intTy, Operator::Div, llvm::Instruction::SDiv);
+    addOp(byteTy, Operator::Div, llvm::Instruction::UDiv);
+    addOp(floatTy, Operator::Div, llvm::Instruction::FDiv);
+    addOp(doubleTy, Operator::Div, llvm::Instruction::FDiv);
+
+    addOp(intTy, Operator::Mod, llvm::Instruction::SRem);
+    addOp(byteTy, Operator::Mod, llvm::Instruction::URem);
+    addOp(floatTy, Operator::Mod, llvm::Instruction::FRem);
+    addOp(doubleTy, Operator::Mod, llvm::Instruction::FRem);
+
+    addCmp(intTy, Operator::Eq, llvm::CmpInst::ICMP_EQ);
+    addCmp(intTy, Operator::Neq, llvm::CmpInst::ICMP_NE);
+    addCmp(intTy, Operator::Less, llvm::CmpInst::ICMP_SLT);
+    addCmp(intTy, Operator::Greater, llvm::CmpInst::ICMP_SGT);
+    addCmp(intTy, Operator::Leq, llvm::CmpInst::ICMP_SLE);
+    addCmp(intTy, Operator::Geq, llvm::CmpInst::ICMP_SGE);
+
+    addCmp(byteTy, Operator::Eq, llvm::CmpInst::ICMP_EQ);
+    addCmp(byteTy, Operator::Neq, llvm::CmpInst::ICMP_NE);
+    addCmp(byteTy, Operator::Less, llvm::CmpInst::ICMP_ULT);
+    addCmp(byteTy, Operator::Greater, llvm::CmpInst::ICMP_UGT);
+    addCmp(byteTy, Operator::Leq, llvm::CmpInst::ICMP_ULE);
+    addCmp(byteTy, Operator::Geq, llvm::CmpInst::ICMP_UGE);
+
+    addCmp(boolTy, Operator::Eq, llvm::CmpInst::ICMP_EQ);
+    addCmp(boolTy, Operator::Neq, llvm::CmpInst::ICMP_NE);
+
+    for (auto type : { floatTy, doubleTy }) {
+        addCmp(type, Operator::Eq, llvm::CmpInst::FCMP_OEQ);
+        addCmp(type, Operator::Neq, llvm::CmpInst::FCMP_ONE);
+        addCmp(type, Operator::Less, llvm::CmpInst::FCMP_OLT);
+        addCmp(type, Operator::Greater, llvm::CmpInst::FCMP_OGT);
+        addCmp(type, Operator::Leq, llvm::CmpInst::FCMP_OLE);
+        addCmp(type, Operator::Geq, llvm::CmpInst::FCMP_OGE);
+    }
 
-    addOp(intTy, "%", llvm::Instruction::SRem);
-    addOp(floatTy, "%", llvm::Instruction::FRem);
-    addOp(doubleTy, "%", llvm::Instruction::FRem);
+    orderingTab["relaxed"] = llvm::AtomicOrdering::Monotonic;
+    orderingTab["acquire"] = llvm::AtomicOrdering::Acquire;
+    orderingTab["release"] = llvm::AtomicOrdering::Release;
+    orderingTab["acq_rel"] = llvm::AtomicOrdering::AcquireRelease;
+    orderingTab["seq_cst"] = llvm::AtomicOrdering::SequentiallyConsistent;
+
+    addAtomicOp("Atomic.add", llvm::AtomicRMWInst::Add);
+    addAtomicOp("Atomic.sub", llvm::AtomicRMWInst::Sub);
+    addAtomicOp("Atomic.swap", llvm::AtomicRMWInst::Xchg);
+    addAtomicOp("Atomic.min", llvm::AtomicRMWInst::Min);
+    addAtomicOp("Atomic.max", llvm::AtomicRMWInst::Max);
 }
 
 void TypeSys::addCoercion(llvm::Type *l, llvm::Type *r, llvm::Type *result)
@@ -52,9 +129,19 @@ void TypeSys::addCast(llvm::Type * from, llvm::Type * to, llvm::CastInst::CastOp
     castTab[from][to] = op;
 }
 
-void TypeSys::addOp(llvm::Type * type, std::string op, llvm::Instruction::BinaryOps llvmOp)
+void TypeSys::addOp(llvm::Type * type, Operator op, llvm::Instruction::BinaryOps llvmOp)
+{
+    mathOpTab[(int) getKind(type)][(int) op] = llvmOp;
+}
+
+void TypeSys::addCmp(llvm::Type * type, Operator op, llvm::CmpInst::Predicate predicate)
 {
-    mathOpTab[std::pair<llvm::Type*, std::string>(type, op)] = llvmOp;
+    cmpTab[(int) getKind(type)][(int) op] = predicate;
+}
+
+void TypeSys::addAtomicOp(const char * name, llvm::AtomicRMWInst::BinOp op)
+{
+    atomicOpTab[Symbol::get(name)] = op;
 }
 
 llvm::CastInst::CastOps TypeSys::getCastOp(llvm::Type * from, llvm::Type * to)
@@ -112,94 +199,86 @@ llvm::Value * TypeSys::cast(llvm::Value * value, llvm::Type * type, llvm::BasicB
     return llvm::CastInst::Create(getCastOp(value->getType(), type), value, type, "cast", block);
 }
 
-llvm::Instruction::BinaryOps TypeSys::getMathOp(llvm::Type *type, std::string op)
+TypeKind TypeSys::getKind(llvm::Type * type)
 {
-    return mathOpTab[std::pair<llvm::Type*, std::string>(type, op)];
-}
+    if (type == intTy) {
+        return TypeKind::Int;
+    } else if (type == floatTy) {
+        return TypeKind::Float;
+    } else if (type == doubleTy) {
+        return TypeKind::Double;
+    } else if (type == boolTy) {
+        return TypeKind::Bool;
+    } else if (type == byteTy) {
+        return TypeKind::Byte;
+    }
 
-bool TypeSys::isFP(llvm::Type * type)
-{
-    return type != intTy;
+    return TypeKind::Other;
 }
 
-llvm::CmpInst::Predicate TypeSys::getCmpPredicate(llvm::Type * type, std::string op)
+llvm::Instruction::BinaryOps TypeSys::getMathOp(llvm::Type * type, Operator op)
 {
-    if (type == intTy) {
-        if (op == "==") {
-            return llvm::CmpInst::Predicate::ICMP_EQ;
-        } else if (op == "!=") {
-            return llvm::CmpInst::Predicate::ICMP_NE;
-        } else if (op == "<") {
-            return llvm::CmpInst::Predicate::ICMP_SLT;
-        } else if (op == ">") {
-            return llvm::CmpInst::Predicate::ICMP_SGT;
-        } else if (op == "<=") {
-            return llvm::CmpInst::Predicate::ICMP_SLE;
-        } else if (op == ">=") {
-            return llvm::CmpInst::Predicate::ICMP_SGE;
-        }
-    } else {
-        if (op == "==") {
-            return llvm::CmpInst::Predicate::FCMP_OEQ;
-        } else if (op == "!=") {
-            return llvm::CmpInst::Predicate::FCMP_ONE;
-        } else if (op == "<") {
-            return llvm::CmpInst::Predicate::FCMP_OLT;
-        } else if (op == ">") {
-            return llvm::CmpInst::Predicate::FCMP_OGT;
-        } else if (op == "<=") {
-            return llvm::CmpInst::Predicate::FCMP_OLE;
-        } else if (op == ">=") {
-            return llvm::CmpInst::Predicate::FCMP_OGE;
-        }
+    auto llvmOp = mathOpTab[(int) getKind(type)][(int) op];
+
+    if (llvmOp == llvm::Instruction::BinaryOpsEnd) {
+        throw std::runtime_error("Not a math operator for type " + std::to_string(type->getTypeID()));
     }
 
-    throw std::runtime_error("Not a comparison operator: " + op);
+    return llvmOp;
 }
 
-void TypeSys::addStructType(std::string name, llvm::StructType * type)
+bool TypeSys::isFP(llvm::Type * type)
 {
-    if (structTypes.find(name) != structTypes.end()) {
-        throw std::runtime_error("Struct type already defined: " + name);
+    return type->isFloatingPointTy();
+}
+
+llvm::CmpInst::Predicate TypeSys::getCmpPredicate(llvm::Type * type, Operator op)
+{
+    auto predicate = cmpTab[(int) getKind(type)][(int) op];
+
+    if (predicate == llvm::CmpInst::BAD_ICMP_PREDICATE) {
+        throw std::runtime_error("Not a comparison operator for type " + std::to_string(type->getTypeID()));
     }
 
-    structTypes[name] = std::pair<llvm::StructType*, std::vector<std::string>>(type,
-            std::vector<std::string>());
+    return predicate;
 }
 
-llvm::StructType * TypeSys::getStructType(std::string name)
+llvm::AtomicOrdering TypeSys::getOrdering(const std::string & name)
 {
-    if (structTypes.find(name) == structTypes.end()) {
-        throw std::runtime_error("Struct type not defined: " + name);
+    auto it = orderingTab.find(name);
+
+    if (it == orderingTab.end()) {
+        throw std::runtime_error("Unknown memory ordering: " + name);
     }
 
-    return structTypes[name].first;
+    return it->second;
 }
 
-int TypeSys::getStructMemberIndex(std::string structName, std::string member)
+llvm::AtomicRMWInst::BinOp TypeSys::getAtomicOp(Symbol name)
 {
-    auto it = structTypes.find(structName);
+    auto it = atomicOpTab.find(name);
 
-    if (it == structTypes.end()) {
-        throw std::runtime_error("Unknown struct: " + structName);
+    if (it == atomicOpTab.end()) {
+        throw std::runtime_error("Not an atomic operation: " + name.str());
     }
 
-    std::vector<std::string> members = it->second.second;
+    return it->second;
+}
 
-    for (int i = 0; i < members.size(); ++i) {
-        if (members[i] == member) {
-            return i;
-        }
+void TypeSys::addStructType(Symbol name, llvm::StructType * type)
+{
+    if (!structTypes.insert(std::make_pair(name, type)).second) {
+        throw std::runtime_error("Struct type already defined: " + name.str());
     }
-
-    throw std::runtime_error("Unknown member: " + member + " for struct: " + structName);
 }
 
-void TypeSys::setStructMembers(std::string name, std::vector<std::string> members)
+llvm::StructType * TypeSys::getStructType(Symbol name)
 {
     auto it = structTypes.find(name);
 
-    if (it != structTypes.end()) {
-        it->second.second = members;
+    if (it == structTypes.end()) {
+        throw std::runtime_error("Struct type not defined: " + name.str());
     }
+
+    return it->second;
 }
@@ -2,9 +2,30 @@
 #define VFS_TYPESYS_HPP
 
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/LLVMContext.h>
 
+#include "../ast/Operator.hpp"
+#include "../context/Symbol.hpp"
+
+/**
+ * The kinds of values operators work on, used to index the operator tables.
+ */
+enum class TypeKind
+{
+    Int,
+    Float,
+    Double,
+    Bool,
+    Byte,
+    Other,
+    Count
+};
+
 class TypeSys
 {
 private:
@@ -12,28 +33,52 @@ private:
 
     std::map<llvm::Type*, std::map<llvm::Type*, llvm::CastInst::CastOps>> castTab;
 
-    std::map<std::pair<llvm::Type*, std::string>, llvm::Instruction::BinaryOps> mathOpTab;
+    static const int kindCount = (int) TypeKind::Count;
+    static const int opCount = (int) Operator::Count;
+
+    llvm::Instruction::BinaryOps mathOpTab[kindCount][opCount];
+
+    llvm::CmpInst::Predicate cmpTab[kindCount][opCount];
+
+    std::unordered_map<Symbol, llvm::StructType*> structTypes;
 
-    std::map<std::string, std::pair<llvm::StructType*, std::vector<std::string>>> structTypes;
+    std::map<std::string, llvm::AtomicOrdering> orderingTab;
+
+    std::unordered_map<Symbol, llvm::AtomicRMWInst::BinOp> atomicOpTab;
 
     void addCoercion(llvm::Type *l, llvm::Type *r, llvm::Type *result);
 
     void addCast(llvm::Type * from, llvm::Type * to, llvm::CastInst::CastOps op);
 
-    void addOp(llvm::Type * type, std::string op, llvm::Instruction::BinaryOps llvmOp);
+    void addOp(llvm::Type * type, Operator op, llvm::Instruction::BinaryOps llvmOp);
+
+    void addCmp(llvm::Type * type, Operator op, llvm::CmpInst::Predicate predicate);
+
+    void addAtomicOp(const char * name, llvm::AtomicRMWInst::BinOp op);
 
     llvm::CastInst::CastOps getCastOp(llvm::Type * from, llvm::Type * to);
 
 public:
-    llvm::Type * floatTy = llvm::Type::getFloatTy(llvm::getGlobalContext());
-    llvm::Type * intTy = llvm::Type::getInt32Ty(llvm::getGlobalContext());
-    llvm::Type * charTy = llvm::Type::getInt8Ty(llvm::getGlobalContext());
-    llvm::Type * doubleTy = llvm::Type::getDoubleTy(llvm::getGlobalContext());
-    llvm::Type * boolTy = llvm::Type::getInt1Ty(llvm::getGlobalContext());
-    llvm::Type * stringTy = llvm::Type::getInt8PtrTy(llvm::getGlobalContext());
-    llvm::Type * voidTy = llvm::Type::getVoidTy(llvm::getGlobalContext());
+    llvm::Type * floatTy;
+    llvm::Type * intTy;
+    llvm::Type * charTy;
+    llvm::Type * doubleTy;
+    llvm::Type * boolTy;
+    llvm::Type * voidTy;
+
+    // bytes are unsigned, and are the elements of mapped files.
+    llvm::Type * byteTy;
+
+    // an atomic is an int that tasks share. Atomic variables point to one.
+    llvm::Type * atomicTy;
+
+    // a string is { length, characters or a pointer to them, capacity }, see vfs/runtime/string.c.
+    llvm::StructType * stringTy;
 
-    TypeSys();
+    // a builder is { buffer, length, capacity }. Builder variables point to one.
+    llvm::StructType * builderTy;
+
+    TypeSys(llvm::LLVMContext & context);
 
     /**
      * Takes two types and returns a type that they both can cast to.
@@ -56,6 +101,11 @@ public:
      */
     llvm::Value * cast(llvm::Value * value, llvm::Type * type, llvm::BasicBlock * block);
 
+    /**
+     * @return the kind of the given type, Other if operators do not apply to it.
+     */
+    TypeKind getKind(llvm::Type * type);
+
     /**
      * Returns the math operation for the given type and op.
      *
@@ -63,22 +113,39 @@ public:
      *
      * @return the LLVM math operator.
      */
-    llvm::Instruction::BinaryOps getMathOp(llvm::Type * type, std::string op);
+    llvm::Instruction::BinaryOps getMathOp(llvm::Type * type, Operator op);
 
     /**
      * @return true if the type is a floating point.
      */
     bool isFP(llvm::Type * type);
 
-    llvm::CmpInst::Predicate getCmpPredicate(llvm::Type * type, std::string op);
+    /**
+     * Returns the comparison predicate for the given type and op. Whether it is an integer or
+     * a floating point predicate can be told with CmpInst::isFPPredicate.
+     *
+     * @param op    one of: ==, !=, <, >, <=, >=
+     */
+    llvm::CmpInst::Predicate getCmpPredicate(llvm::Type * type, Operator op);
 
-    void addStructType(std::string name, llvm::StructType * type);
+    /**
+     * Returns the memory ordering of an atomic operation by its name in C11, which is one of:
+     * relaxed, acquire, release, acq_rel, seq_cst.
+     *
+     * This method will throw an exception in case there is no such ordering.
+     */
+    llvm::AtomicOrdering getOrdering(const std::string & name);
 
-    void setStructMembers(std::string name, std::vector<std::string> members);
+    /**
+     * Returns the read-modify-write operation of an atomic builtin.
+     *
+     * @param name  one of: Atomic.add, Atomic.sub, Atomic.swap, Atomic.min, Atomic.max
+     */
+    llvm::AtomicRMWInst::BinOp getAtomicOp(Symbol name);
 
-    llvm::StructType * getStructType(std::string name);
+    void addStructType(Symbol name, llvm::StructType * type);
 
-    int getStructMemberIndex(std::string structName, std::string member);
+    llvm::StructType * getStructType(Symbol name);
 };
 
 #endif //VFS_TYPESYS_HPP
@@ -1,39 +1,65 @@
 #include "Types.hpp"
 
+#include "../context/Arena.hpp"
 
-std::shared_ptr<Type> Type::createVoid()
-{
-    return std::make_shared<Type>("void");
-}
+
+static const Symbol intName = Symbol::get("int");
+static const Symbol floatName = Symbol::get("float");
+static const Symbol stringName = Symbol::get("string");
+static const Symbol boolName = Symbol::get("bool");
+static const Symbol builderName = Symbol::get("builder");
+static const Symbol byteName = Symbol::get("byte");
+static const Symbol fileName = Symbol::get("file");
+static const Symbol atomicName = Symbol::get("atomic");
+static const Symbol queueName = Symbol::get("queue");
+static const Symbol counterName = Symbol::get("counter");
 
 llvm::Type * Type::getType(TypeSys & typeSys)
 {
-    if (name == "int") {
+    if (name == intName) {
         return typeSys.intTy;
     }
 
-    if (name == "float") {
+    if (name == floatName) {
         return typeSys.floatTy;
     }
 
-    if (name == "string") {
+    if (name == stringName) {
         return typeSys.stringTy;
     }
 
-    if (name == "bool") {
+    if (name == boolName) {
         return typeSys.boolTy;
     }
 
+    if (name == builderName) {
+        return llvm::PointerType::get(typeSys.builderTy, 0);
+    }
+
+    if (name == byteName) {
+        return typeSys.byteTy;
+    }
+
+    if (name == atomicName) {
+        return llvm::PointerType::get(typeSys.atomicTy, 0);
+    }
+
+    // files, queues and counters are handles of the runtime, see vfs/runtime/file.c and
+    // vfs/runtime/concurrent.c.
+    if (name == fileName || name == queueName || name == counterName) {
+        return llvm::PointerType::get(typeSys.charTy, 0);
+    }
+
     return typeSys.voidTy;
 }
 
 llvm::Value * Type::getDefaultValue(std::shared_ptr<llvm::LLVMContext> context)
 {
-    if (name == "int") {
+    if (name == intName) {
         return llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context), 0, true);
     }
 
-    if (name == "float") {
+    if (name == floatName) {
         return llvm::ConstantFP::get(llvm::Type::getFloatTy(*context), 0);
     }
 
@@ -42,10 +68,37 @@ llvm::Value * Type::getDefaultValue(std::shared_ptr<llvm::LLVMContext> context)
 
 llvm::Type * ArrayType::getType(TypeSys & typeSys)
 {
-    return llvm::PointerType::get(Type::getType(typeSys), 0);
+    return llvm::PointerType::get(element->getType(typeSys), 0);
 }
 
 llvm::Type * StructType::getType(TypeSys & typeSys)
 {
     return llvm::PointerType::get(typeSys.getStructType(name), 0);
 }
+
+// a task is the frame of its call, see vfs/runtime/task.c.
+llvm::Type * TaskType::getType(TypeSys & typeSys)
+{
+    return llvm::PointerType::get(typeSys.charTy, 0);
+}
+
+Type * Type::clone(Arena & arena)
+{
+    return arena.make<Type>(name);
+}
+
+Type * ArrayType::clone(Arena & arena)
+{
+    // the size only matters to declarations of variables, which are never cloned.
+    return arena.make<ArrayType>(element->clone(arena), nullptr);
+}
+
+Type * StructType::clone(Arena & arena)
+{
+    return arena.make<StructType>(name);
+}
+
+Type * TaskType::clone(Arena & arena)
+{
+    return arena.make<TaskType>(result->clone(arena));
+}
@@ -2,6 +2,8 @@
 #define VFS_TYPES_HPP
 
 #include <map>
+#include <memory>
+#include <string>
 
 #include <llvm/IR/Type.h>
 #include <llvm/IR/LLVMContext.h>
@@ -11,20 +13,40 @@
 #include "../ast/SyntaxTree.hpp"
 #include "TypeSys.hpp"
 
+class Arena;
 
 struct Type
 {
-    std::string name;
+    Symbol name;
 
-    Type(std::string name) : name(name) {}
+    Type(Symbol name) : name(name) {}
     virtual ~Type() = default;
 
-    static std::shared_ptr<Type> createVoid();
-
     virtual llvm::Type * getType(TypeSys & typeSys);
 
+    /**
+     * @return a copy of the type that lives in the given arena.
+     */
+    virtual Type * clone(Arena & arena);
+
     llvm::Value * getDefaultValue(std::shared_ptr<llvm::LLVMContext> context);
 
+    /**
+     * @return true if both types are the same VFS type.
+     */
+    virtual bool equals(Type * other)
+    {
+        return !other->isArray() && !other->isTask() && name == other->name;
+    }
+
+    /**
+     * @return the type as written in the source, for error messages.
+     */
+    virtual std::string str()
+    {
+        return name.str();
+    }
+
     virtual bool isArray()
     {
         return false;
@@ -34,20 +56,38 @@ struct Type
     {
         return false;
     }
+
+    virtual bool isTask()
+    {
+        return false;
+    }
 };
 
 
 struct ArrayType : Type
 {
-    std::shared_ptr<Expression> size;
+    Type * element;
+    Expression * size;
 
-    ArrayType(std::string name, std::shared_ptr<Expression> size = std::make_shared<Integer>(1)) :
-            Type(name), size(size) {}
+    ArrayType(Type * element, Expression * size) :
+            Type(element->name), element(element), size(size) {}
 
     virtual ~ArrayType() = default;
 
     virtual llvm::Type * getType(TypeSys & typeSys);
 
+    virtual Type * clone(Arena & arena);
+
+    virtual bool equals(Type * other)
+    {
+        return other->isArray() && element->equals(static_cast<ArrayType *>(other)->element);
+    }
+
+    virtual std::string str()
+    {
+        return element->str() + "[]";
+    }
+
     virtual bool isArray()
     {
         return true;
@@ -57,12 +97,19 @@ struct ArrayType : Type
 
 struct StructType : Type
 {
-    StructType(std::string name) : Type(name) {}
+    StructType(Symbol name) : Type(name) {}
 
     virtual ~StructType() = default;
 
     virtual llvm::Type * getType(TypeSys & typeSys);
 
+    virtual Type * clone(Arena & arena);
+
+    virtual std::string str()
+    {
+        return "#" + name.str();
+    }
+
     virtual bool isStruct()
     {
         return true;
@@ -70,4 +117,37 @@ struct StructType : Type
 };
 
 
+/**
+ * The type of a spawned call. Tasks can only be made by spawn, kept in variables and awaited,
+ * so each has one variable at most, which can tell when it is done with it.
+ */
+struct TaskType : Type
+{
+    Type * result;
+
+    TaskType(Type * result) : Type(Symbol::get("task")), result(result) {}
+
+    virtual ~TaskType() = default;
+
+    virtual llvm::Type * getType(TypeSys & typeSys);
+
+    virtual Type * clone(Arena & arena);
+
+    virtual bool equals(Type * other)
+    {
+        return other->isTask() && result->equals(static_cast<TaskType *>(other)->result);
+    }
+
+    virtual std::string str()
+    {
+        return "task of " + result->str();
+    }
+
+    virtual bool isTask()
+    {
+        return true;
+    }
+};
+
+
 #endif //VFS_TYPES_HPP